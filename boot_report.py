@@ -0,0 +1,102 @@
+"""Aggregate the boot traces logged by udp.py and flag stages that got slower.
+
+    python boot_report.py [--file boot_traces.jsonl] [--agv 3] [--recent 10] [--threshold 20]
+
+The newest --recent boots are compared against all older ones; a stage whose
+median duration grew by more than --threshold percent is reported as a regression.
+"""
+import argparse
+import json
+import statistics
+import sys
+
+from udp import BOOT_LOG, BOOT_STAGES
+
+READY = "ready"     # Latest end of any stage, boot-to-ready time
+
+
+def load(path, agv_id=None):
+    traces = []
+    with open(path) as log:
+        for line in log:
+            line = line.strip()
+            if not line:
+                continue
+            trace = json.loads(line)
+            if agv_id is None or trace["agv_id"] == agv_id:
+                traces.append(trace)
+    traces.sort(key=lambda trace: trace["time"])
+    return traces
+
+
+def durations(traces):
+    """Return {stage: [duration_ms, ...]} over the boots where the stage finished."""
+    out = {}
+    for trace in traces:
+        ends = []
+        for name, (begin_ms, took_ms) in trace["stages"].items():
+            if took_ms is None:
+                continue
+            out.setdefault(name, []).append(took_ms)
+            ends.append(begin_ms + took_ms)
+        if ends:
+            out.setdefault(READY, []).append(max(ends))
+    return out
+
+
+def percentile(values, pct):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(round(pct / 100 * (len(values) - 1))))]
+
+
+def stage_order(names):
+    known = [name for name in BOOT_STAGES if name in names]
+    return known + sorted(set(names) - set(known) - {READY}) + ([READY] if READY in names else [])
+
+
+def summary(title, stats):
+    print(title)
+    print(f"    {'stage':<16} {'boots':>6} {'median':>9} {'p90':>9} {'max':>9}  (ms)")
+    for name in stage_order(stats):
+        values = stats[name]
+        print(f"    {name:<16} {len(values):6d} {statistics.median(values):9.1f} "
+              f"{percentile(values, 90):9.1f} {max(values):9.1f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--file", default=BOOT_LOG)
+    parser.add_argument("--agv", type=int, help="Only this AGV id")
+    parser.add_argument("--recent", type=int, default=10, help="Boots compared against the older ones")
+    parser.add_argument("--threshold", type=float, default=20.0, help="Median growth in percent to flag")
+    args = parser.parse_args()
+
+    traces = load(args.file, args.agv)
+    if not traces:
+        print(f"No boot traces in {args.file}")
+        return 0
+
+    summary(f"All {len(traces)} boots", durations(traces))
+    if len(traces) <= args.recent:
+        return 0
+
+    baseline = durations(traces[:-args.recent])
+    recent = durations(traces[-args.recent:])
+    summary(f"Newest {args.recent} boots", recent)
+
+    regressions = 0
+    for name in stage_order(recent):
+        if name not in baseline:
+            continue
+        before = statistics.median(baseline[name])
+        after = statistics.median(recent[name])
+        if before > 0 and (after - before) / before * 100 > args.threshold:
+            print(f"REGRESSION {name}: median {before:.1f} ms -> {after:.1f} ms")
+            regressions += 1
+    if not regressions:
+        print(f"No stage slower than {args.threshold:.0f}% over its baseline")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -12,6 +12,7 @@
 #include <sys/param.h>
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
@@ -69,6 +70,15 @@ static const char *TAG = "hid-host";
 
 #define DEFAULT_TIMEOUT_MS  (5000)
 
+// Interface handle encoding: slot index in the low bits, slot generation above
+#define HID_IFACE_SLOT_NUM          (8)
+#define HID_IFACE_SLOT_BITS         (3)
+#define HID_IFACE_SLOT_MASK         ((1U << HID_IFACE_SLOT_BITS) - 1)
+#define HID_IFACE_HANDLE(slot, gen) ((hid_host_device_handle_t)(uintptr_t)(((uintptr_t)(gen) << HID_IFACE_SLOT_BITS) | (slot)))
+#define HID_IFACE_HANDLE_SLOT(hdl)  ((uintptr_t)(hdl) & HID_IFACE_SLOT_MASK)
+#define HID_IFACE_HANDLE_GEN(hdl)   ((uint32_t)((uintptr_t)(hdl) >> HID_IFACE_SLOT_BITS))
+#define HID_IFACE_GEN_MAX           (UINT32_MAX >> HID_IFACE_SLOT_BITS)    /**< Slot generations are uint32_t */
+
 /**
  * @brief HID Device structure.
  *
@@ -80,6 +90,7 @@ typedef struct hid_host_device {
     usb_transfer_t *ctrl_xfer;                  /**< Pointer to control transfer buffer */
     usb_device_handle_t dev_hdl;                /**< USB device handle */
     uint8_t dev_addr;                           /**< USB device address */
+    int64_t installed_us;                       /**< Time the device was recognised as HID */
 } hid_device_t;
 
 /**
@@ -100,6 +111,7 @@ typedef enum {
  */
 typedef struct hid_interface {
     STAILQ_ENTRY(hid_interface) tailq_entry;
+    hid_host_device_handle_t handle;        /**< External handle, encodes the slot and its generation */
     hid_device_t *parent;                   /**< Parent USB HID device */
     hid_host_dev_params_t dev_params;       /**< USB device parameters */
     uint8_t ep_in;                          /**< Interrupt IN EP number */
@@ -107,12 +119,28 @@ typedef struct hid_interface {
     uint8_t country_code;                   /**< Country code */
     uint16_t report_desc_size;              /**< Size of Report */
     uint8_t *report_desc;                   /**< Pointer to HID Report */
-    usb_transfer_t *in_xfer;                /**< Pointer to IN transfer buffer */
+    usb_transfer_t *in_xfer[HID_HOST_IN_XFER_NUM_MAX]; /**< IN transfers queued on the endpoint */
+    uint8_t in_xfer_num;                    /**< Number of allocated IN transfers */
+    uint8_t in_xfer_pending;                /**< Number of IN transfers currently queued */
+    usb_transfer_t *last_in_xfer;           /**< Most recently completed IN transfer */
+    hid_host_dev_stats_t stats;             /**< Input statistics */
+    hid_host_dev_timing_t timing;           /**< Enumeration and last report timestamps */
     hid_host_interface_event_cb_t user_cb;  /**< Interface application callback */
     void *user_cb_arg;                      /**< Interface application callback arg */
+    hid_host_input_report_cb_t user_report_cb; /**< Interface application zero-copy input report callback */
     hid_iface_state_t state;                /**< Interface state */
 } hid_iface_t;
 
+/**
+ * @brief HID Interface handle slot
+ *
+ * The generation is bumped every time the slot is freed, so stale handles never validate.
+ */
+typedef struct {
+    hid_iface_t *iface;                     /**< Interface in the slot, NULL if free */
+    uint32_t gen;                           /**< Slot generation, part of the handle */
+} hid_iface_slot_t;
+
 /**
  * @brief HID driver default context
  *
@@ -121,6 +149,7 @@ typedef struct hid_interface {
 typedef struct {
     STAILQ_HEAD(devices, hid_host_device) hid_devices_tailq;    /**< STAILQ of HID interfaces */
     STAILQ_HEAD(interfaces, hid_interface) hid_ifaces_tailq;    /**< STAILQ of HID interfaces */
+    hid_iface_slot_t iface_slots[HID_IFACE_SLOT_NUM];           /**< Handle to Interface table */
     usb_host_client_handle_t client_handle;                     /**< Client task handle */
     hid_host_driver_event_cb_t user_cb;                         /**< User application callback */
     void *user_arg;                                             /**< User application callback args */
@@ -205,7 +234,9 @@ static inline hid_device_t *get_hid_device_from_context(usb_transfer_t *xfer)
 }
 
 /**
- * @brief Verify presence of Interface in the RAM list
+ * @brief Verify presence of Interface in the handle table
+ *
+ * Constant time, no critical section: the slot is read once and compared.
  *
  * @param[in] iface         Pointer to an Interface structure
  * @return true             Interface is in the list
@@ -213,36 +244,29 @@ static inline hid_device_t *get_hid_device_from_context(usb_transfer_t *xfer)
  */
 static inline bool is_interface_in_list(hid_iface_t *iface)
 {
-    hid_iface_t *interface = NULL;
-
-    HID_ENTER_CRITICAL();
-    STAILQ_FOREACH(interface, &s_hid_driver->hid_ifaces_tailq, tailq_entry) {
-        if (iface == interface) {
-            HID_EXIT_CRITICAL();
-            return true;
-        }
-    }
-
-    HID_EXIT_CRITICAL();
-    return false;
+    return iface && (s_hid_driver->iface_slots[HID_IFACE_HANDLE_SLOT(iface->handle)].iface == iface);
 }
 
 /**
- * @brief Get HID Interface pointer by external HID Device handle with verification in RAM list
+ * @brief Get HID Interface pointer by external HID Device handle with verification in the handle table
+ *
+ * Constant time, no critical section and no list walk, so it is cheap enough for every input report.
  *
  * @param[in] hid_dev_handle HID Device handle
  * @return hid_iface_t       Pointer to an Interface structure
  */
 static hid_iface_t *get_iface_by_handle(hid_host_device_handle_t hid_dev_handle)
 {
-    hid_iface_t *hid_iface = (hid_iface_t *) hid_dev_handle;
-
-    if (!is_interface_in_list(hid_iface)) {
-        ESP_LOGE(TAG, "HID interface handle not found");
-        return NULL;
+    if (s_hid_driver) {
+        const hid_iface_slot_t *slot = &s_hid_driver->iface_slots[HID_IFACE_HANDLE_SLOT(hid_dev_handle)];
+        hid_iface_t *hid_iface = slot->iface;
+        if (hid_iface && (slot->gen == HID_IFACE_HANDLE_GEN(hid_dev_handle))) {
+            return hid_iface;
+        }
     }
 
-    return hid_iface;
+    ESP_LOGE(TAG, "HID interface handle not found");
+    return NULL;
 }
 
 /**
@@ -306,7 +330,7 @@ static inline void hid_host_user_interface_callback(hid_iface_t *hid_iface,
     assert(dev_params);
 
     if (hid_iface->user_cb) {
-        hid_iface->user_cb(hid_iface, event, hid_iface->user_cb_arg);
+        hid_iface->user_cb(hid_iface->handle, event, hid_iface->user_cb_arg);
     }
 }
 
@@ -326,7 +350,7 @@ static inline void hid_host_user_device_callback(hid_iface_t *hid_iface,
     assert(dev_params);
 
     if (s_hid_driver && s_hid_driver->user_cb) {
-        s_hid_driver->user_cb(hid_iface, event, s_hid_driver->user_arg);
+        s_hid_driver->user_cb(hid_iface->handle, event, s_hid_driver->user_arg);
     }
 }
 
@@ -351,6 +375,18 @@ static esp_err_t hid_host_add_interface(hid_device_t *hid_device,
                         "Unable to allocate memory");
 
     HID_ENTER_CRITICAL();
+    int slot = 0;
+    while (slot < HID_IFACE_SLOT_NUM && s_hid_driver->iface_slots[slot].iface) {
+        slot++;
+    }
+    if (slot == HID_IFACE_SLOT_NUM) {
+        HID_EXIT_CRITICAL();
+        free(hid_iface);
+        ESP_LOGE(TAG, "No free HID interface slot");
+        return ESP_ERR_NO_MEM;
+    }
+    s_hid_driver->iface_slots[slot].iface = hid_iface;
+    hid_iface->handle = HID_IFACE_HANDLE(slot, s_hid_driver->iface_slots[slot].gen);
     hid_iface->parent = hid_device;
     hid_iface->state = HID_INTERFACE_STATE_NOT_INITIALIZED;
     hid_iface->dev_params.addr = hid_device->dev_addr;
@@ -398,6 +434,10 @@ static esp_err_t hid_host_add_interface(hid_device_t *hid_device,
  */
 static esp_err_t _hid_host_remove_interface(hid_iface_t *hid_iface)
 {
+    hid_iface_slot_t *slot = &s_hid_driver->iface_slots[HID_IFACE_HANDLE_SLOT(hid_iface->handle)];
+    slot->iface = NULL;
+    // Generation 0 is never used, so a NULL handle never validates
+    slot->gen = (slot->gen < HID_IFACE_GEN_MAX) ? (slot->gen + 1) : 1;
     hid_iface->state = HID_INTERFACE_STATE_NOT_INITIALIZED;
     STAILQ_REMOVE(&s_hid_driver->hid_ifaces_tailq, hid_iface, hid_interface, tailq_entry);
     free(hid_iface);
@@ -535,7 +575,7 @@ static esp_err_t hid_host_device_disconnected(usb_device_handle_t dev_hdl)
         HID_EXIT_CRITICAL();
 
         if (hid_iface_curr->parent && (hid_iface_curr->parent->dev_addr == hid_device->dev_addr)) {
-            HID_RETURN_ON_ERROR( hid_host_device_close(hid_iface_curr),
+            HID_RETURN_ON_ERROR( hid_host_device_close(hid_iface_curr->handle),
                                  "Unable to close device");
         }
         HID_ENTER_CRITICAL();
@@ -578,12 +618,28 @@ static esp_err_t hid_host_interface_claim_and_prepare_transfer(hid_iface_t *ifac
                          iface->dev_params.iface_num, 0),
                          "Unable to claim Interface");
 
-    HID_RETURN_ON_ERROR( usb_host_transfer_alloc(iface->ep_in_mps, 0, &iface->in_xfer),
-                         "Unable to allocate transfer buffer for EP IN");
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i < iface->in_xfer_num; i++) {
+        HID_GOTO_ON_ERROR( usb_host_transfer_alloc(iface->ep_in_mps, 0, &iface->in_xfer[i]),
+                           "Unable to allocate transfer buffer for EP IN");
+    }
 
     // Change state
     iface->state = HID_INTERFACE_STATE_READY;
     return ESP_OK;
+
+fail:
+    // Undo the transfers allocated so far and the claim, the interface stays IDLE
+    for (int i = 0; i < iface->in_xfer_num; i++) {
+        if (iface->in_xfer[i]) {
+            usb_host_transfer_free(iface->in_xfer[i]);
+            iface->in_xfer[i] = NULL;
+        }
+    }
+    usb_host_interface_release(s_hid_driver->client_handle,
+                               iface->parent->dev_hdl,
+                               iface->dev_params.iface_num);
+    return ret;
 }
 
 /**
@@ -606,7 +662,11 @@ static esp_err_t hid_host_interface_release_and_free_transfer(hid_iface_t *iface
                          iface->dev_params.iface_num),
                          "Unable to release HID Interface");
 
-    ESP_ERROR_CHECK( usb_host_transfer_free(iface->in_xfer) );
+    for (int i = 0; i < iface->in_xfer_num; i++) {
+        ESP_ERROR_CHECK( usb_host_transfer_free(iface->in_xfer[i]) );
+        iface->in_xfer[i] = NULL;
+    }
+    iface->last_in_xfer = NULL;
 
     // Change state
     iface->state = HID_INTERFACE_STATE_IDLE;
@@ -646,6 +706,10 @@ static esp_err_t hid_host_disable_interface(hid_iface_t *iface)
 /**
  * @brief HID IN Transfer complete callback
  *
+ * With several IN transfers per interface, the others stay queued on the endpoint while
+ * the user callback runs, so the device keeps being polled. The completed transfer is
+ * resubmitted after the callback, as its buffer is lent to the user during the call.
+ *
  * @param[in] transfer  Pointer to transfer data structure
  */
 static void in_xfer_done(usb_transfer_t *in_xfer)
@@ -654,14 +718,30 @@ static void in_xfer_done(usb_transfer_t *in_xfer)
     assert(in_xfer->context);
 
     hid_iface_t *iface = (hid_iface_t *) in_xfer->context;
+    iface->in_xfer_pending--;
 
     switch (in_xfer->status) {
-    case USB_TRANSFER_STATUS_COMPLETED:
-        // Notify user
-        hid_host_user_interface_callback(iface, HID_HOST_INTERFACE_EVENT_INPUT_REPORT);
+    case USB_TRANSFER_STATUS_COMPLETED: {
+        const int64_t report_us = esp_timer_get_time();
+        iface->timing.last_report_us = report_us;
+        iface->stats.reports++;
+        if (iface->in_xfer_pending == 0) {
+            iface->stats.overruns++;
+        }
+        // Notify user, either with a view into the transfer buffer or with an event
+        iface->last_in_xfer = in_xfer;
+        if (iface->user_report_cb) {
+            iface->user_report_cb(iface->handle, in_xfer->data_buffer, in_xfer->actual_num_bytes, report_us,
+                                  iface->user_cb_arg);
+        } else {
+            hid_host_user_interface_callback(iface, HID_HOST_INTERFACE_EVENT_INPUT_REPORT);
+        }
         // Relaunch transfer
-        usb_host_transfer_submit(in_xfer);
+        if (usb_host_transfer_submit(in_xfer) == ESP_OK) {
+            iface->in_xfer_pending++;
+        }
         return;
+    }
     case USB_TRANSFER_STATUS_NO_DEVICE:
     case USB_TRANSFER_STATUS_CANCELED:
         // User is notified about device disconnection from usb_event_cb
@@ -672,6 +752,7 @@ static void in_xfer_done(usb_transfer_t *in_xfer)
         break;
     }
 
+    iface->stats.transfer_errors++;
     ESP_LOGE(TAG, "Transfer failed, status %d", in_xfer->status);
     // Notify user about transfer or any other error
     hid_host_user_interface_callback(iface, HID_HOST_INTERFACE_EVENT_TRANSFER_ERROR);
@@ -846,6 +927,7 @@ static esp_err_t hid_class_request_report_descriptor(hid_iface_t *iface)
     HID_RETURN_ON_FALSE(iface->report_desc,
                         ESP_ERR_NO_MEM,
                         "Unable to allocate memory");
+    iface->timing.report_desc_request_us = esp_timer_get_time();
 
     const hid_class_request_t get_desc = {
         .bRequest = USB_B_REQUEST_GET_DESCRIPTOR,
@@ -855,7 +937,11 @@ static esp_err_t hid_class_request_report_descriptor(hid_iface_t *iface)
         .data = iface->report_desc
     };
 
-    return usb_class_request_get_descriptor(iface->parent, &get_desc);
+    esp_err_t ret = usb_class_request_get_descriptor(iface->parent, &get_desc);
+    if (ret == ESP_OK) {
+        iface->timing.report_desc_done_us = esp_timer_get_time();
+    }
+    return ret;
 }
 
 /**
@@ -988,6 +1074,7 @@ esp_err_t hid_host_install_device(uint8_t dev_addr,
 
     hid_device->dev_addr = dev_addr;
     hid_device->dev_hdl = dev_hdl;
+    hid_device->installed_us = esp_timer_get_time();
 
     HID_GOTO_ON_FALSE( hid_device->ctrl_xfer_done = xSemaphoreCreateBinary(),
                        ESP_ERR_NO_MEM,
@@ -1103,6 +1190,9 @@ esp_err_t hid_host_install(const hid_host_driver_config_t *config)
     s_hid_driver = driver;
     STAILQ_INIT(&s_hid_driver->hid_devices_tailq);
     STAILQ_INIT(&s_hid_driver->hid_ifaces_tailq);
+    for (int i = 0; i < HID_IFACE_SLOT_NUM; i++) {
+        s_hid_driver->iface_slots[i].gen = 1;
+    }
     HID_EXIT_CRITICAL();
 
     if (config->create_background_task) {
@@ -1182,6 +1272,12 @@ esp_err_t hid_host_device_open(hid_host_device_handle_t hid_dev_handle,
                         ESP_ERR_INVALID_STATE,
                         "Interface wrong state");
 
+    HID_RETURN_ON_FALSE(config->in_xfer_num <= HID_HOST_IN_XFER_NUM_MAX,
+                        ESP_ERR_INVALID_ARG,
+                        "Too many IN transfers");
+
+    hid_iface->in_xfer_num = config->in_xfer_num ? config->in_xfer_num : HID_HOST_IN_XFER_NUM_DEFAULT;
+
     // Claim interface, allocate xfer and save report callback
     HID_RETURN_ON_ERROR( hid_host_interface_claim_and_prepare_transfer(hid_iface),
                          "Unable to claim interface");
@@ -1189,6 +1285,7 @@ esp_err_t hid_host_device_open(hid_host_device_handle_t hid_dev_handle,
     // Save HID Interface callback
     hid_iface->user_cb = config->callback;
     hid_iface->user_cb_arg = config->callback_arg;
+    hid_iface->user_report_cb = config->report_callback;
 
     return ESP_OK;
 }
@@ -1226,6 +1323,7 @@ esp_err_t hid_host_device_close(hid_host_device_handle_t hid_dev_handle)
         // Second call
         hid_iface->user_cb = NULL;
         hid_iface->user_cb_arg = NULL;
+        hid_iface->user_report_cb = NULL;
 
         /* Remove Interface from the list */
         ESP_LOGD(TAG, "Remove addr %d, iface %d from list",
@@ -1291,14 +1389,53 @@ esp_err_t hid_host_device_get_raw_input_report_data(hid_host_device_handle_t hid
                         ESP_ERR_INVALID_ARG,
                         "Wrong argument");
 
-    size_t copied = (data_length_max >= iface->in_xfer->actual_num_bytes)
-                    ? iface->in_xfer->actual_num_bytes
+    HID_RETURN_ON_FALSE(iface->last_in_xfer,
+                        ESP_ERR_INVALID_STATE,
+                        "No input report received");
+
+    size_t copied = (data_length_max >= iface->last_in_xfer->actual_num_bytes)
+                    ? iface->last_in_xfer->actual_num_bytes
                     : data_length_max;
-    memcpy(data, iface->in_xfer->data_buffer, copied);
+    memcpy(data, iface->last_in_xfer->data_buffer, copied);
     *data_length = copied;
     return ESP_OK;
 }
 
+esp_err_t hid_host_device_get_stats(hid_host_device_handle_t hid_dev_handle,
+                                    hid_host_dev_stats_t *stats)
+{
+    hid_iface_t *iface = get_iface_by_handle(hid_dev_handle);
+
+    HID_RETURN_ON_FALSE(iface,
+                        ESP_ERR_INVALID_STATE,
+                        "HID Interface not found");
+
+    HID_RETURN_ON_FALSE(stats,
+                        ESP_ERR_INVALID_ARG,
+                        "Wrong argument");
+
+    memcpy(stats, &iface->stats, sizeof(hid_host_dev_stats_t));
+    return ESP_OK;
+}
+
+esp_err_t hid_host_device_get_timing(hid_host_device_handle_t hid_dev_handle,
+                                     hid_host_dev_timing_t *timing)
+{
+    hid_iface_t *iface = get_iface_by_handle(hid_dev_handle);
+
+    HID_RETURN_ON_FALSE(iface,
+                        ESP_ERR_INVALID_STATE,
+                        "HID Interface not found");
+
+    HID_RETURN_ON_FALSE(timing,
+                        ESP_ERR_INVALID_ARG,
+                        "Wrong argument");
+
+    memcpy(timing, &iface->timing, sizeof(hid_host_dev_timing_t));
+    timing->installed_us = iface->parent ? iface->parent->installed_us : 0;
+    return ESP_OK;
+}
+
 // ------------------------ USB HID Host driver API ----------------------------
 
 esp_err_t hid_host_device_start(hid_host_device_handle_t hid_dev_handle)
@@ -1306,7 +1443,7 @@ esp_err_t hid_host_device_start(hid_host_device_handle_t hid_dev_handle)
     hid_iface_t *iface = get_iface_by_handle(hid_dev_handle);
 
     HID_RETURN_ON_INVALID_ARG(iface);
-    HID_RETURN_ON_INVALID_ARG(iface->in_xfer);
+    HID_RETURN_ON_INVALID_ARG(iface->in_xfer[0]);
     HID_RETURN_ON_INVALID_ARG(iface->parent);
 
     HID_RETURN_ON_FALSE(is_interface_in_list(iface),
@@ -1317,18 +1454,32 @@ esp_err_t hid_host_device_start(hid_host_device_handle_t hid_dev_handle)
                          ESP_ERR_INVALID_STATE,
                          "Interface wrong state");
 
-    // prepare transfer
-    iface->in_xfer->device_handle = iface->parent->dev_hdl;
-    iface->in_xfer->callback = in_xfer_done;
-    iface->in_xfer->context = iface;
-    iface->in_xfer->timeout_ms = DEFAULT_TIMEOUT_MS;
-    iface->in_xfer->bEndpointAddress = iface->ep_in;
-    iface->in_xfer->num_bytes = iface->ep_in_mps;
+    // prepare transfers
+    for (int i = 0; i < iface->in_xfer_num; i++) {
+        usb_transfer_t *in_xfer = iface->in_xfer[i];
+        in_xfer->device_handle = iface->parent->dev_hdl;
+        in_xfer->callback = in_xfer_done;
+        in_xfer->context = iface;
+        in_xfer->timeout_ms = DEFAULT_TIMEOUT_MS;
+        in_xfer->bEndpointAddress = iface->ep_in;
+        in_xfer->num_bytes = iface->ep_in_mps;
+    }
 
     iface->state = HID_INTERFACE_STATE_ACTIVE;
+    if (!iface->timing.started_us) {
+        iface->timing.started_us = esp_timer_get_time();
+    }
 
-    // start data transfer
-    return usb_host_transfer_submit(iface->in_xfer);
+    // start data transfer, queue every IN transfer on the endpoint
+    iface->in_xfer_pending = iface->in_xfer_num;
+    for (int i = 0; i < iface->in_xfer_num; i++) {
+        esp_err_t ret = usb_host_transfer_submit(iface->in_xfer[i]);
+        if (ret != ESP_OK) {
+            iface->in_xfer_pending = i;
+            return ret;
+        }
+    }
+    return ESP_OK;
 }
 
 esp_err_t hid_host_device_stop(hid_host_device_handle_t hid_dev_handle)
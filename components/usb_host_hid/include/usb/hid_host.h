@@ -29,7 +29,10 @@ extern "C" {
 */
 #define HID_STR_DESC_MAX_LENGTH           32
 
-typedef struct hid_interface *hid_host_device_handle_t;    /**< Device Handle. Handle to a particular HID interface */
+#define HID_HOST_IN_XFER_NUM_DEFAULT      1     /**< IN transfers per interface when not configured */
+#define HID_HOST_IN_XFER_NUM_MAX          8     /**< Max IN transfers per interface */
+
+typedef struct hid_interface *hid_host_device_handle_t;    /**< Device Handle. Opaque handle to a particular HID interface, validated in constant time */
 
 // ------------------------ USB HID Host events --------------------------------
 /**
@@ -69,6 +72,27 @@ typedef struct {
     uint8_t proto;                      /**< HID Interface Protocol */
 } hid_host_dev_params_t;
 
+/**
+ * @brief USB HID Host interface input statistics
+*/
+typedef struct {
+    uint32_t reports;                   /**< Input reports received */
+    uint32_t overruns;                  /**< Reports that completed with no other IN transfer queued, so the
+                                             endpoint was not polled until the user callback returned */
+    uint32_t transfer_errors;           /**< IN transfers completed with an error */
+} hid_host_dev_stats_t;
+
+/**
+ * @brief USB HID Host interface timestamps, esp_timer_get_time() microseconds, 0 if not reached
+*/
+typedef struct {
+    int64_t installed_us;               /**< USB device recognised as HID, hid_host_install_device() */
+    int64_t report_desc_request_us;     /**< Report Descriptor requested */
+    int64_t report_desc_done_us;        /**< Report Descriptor received */
+    int64_t started_us;                 /**< IN transfers first submitted by hid_host_device_start() */
+    int64_t last_report_us;             /**< Latest IN transfer completed, set before the report is passed to the user */
+} hid_host_dev_timing_t;
+
 // ------------------------ USB HID Host callbacks -----------------------------
 
 /**
@@ -93,6 +117,24 @@ typedef void (*hid_host_interface_event_cb_t)(hid_host_device_handle_t hid_devic
         const hid_host_interface_event_t event,
         void *arg);
 
+/**
+ * @brief USB HID Interface input report callback (zero-copy).
+ *
+ * Called from the IN transfer completion instead of HID_HOST_INTERFACE_EVENT_INPUT_REPORT.
+ * The data pointer refers directly to the transfer buffer and is valid only until the callback returns.
+ *
+ * @param[in] hid_device_handle     HID device handle (HID Interface)
+ * @param[in] data                  Pointer to the raw input report, borrowed from the driver
+ * @param[in] length                Length of the input report
+ * @param[in] report_us             esp_timer_get_time() when the IN transfer completed
+ * @param[in] arg                   User argument
+*/
+typedef void (*hid_host_input_report_cb_t)(hid_host_device_handle_t hid_device_handle,
+        const uint8_t *data,
+        size_t length,
+        int64_t report_us,
+        void *arg);
+
 // ----------------------------- Public ---------------------------------------
 /**
  * @brief HID configuration structure.
@@ -113,6 +155,10 @@ typedef struct {
 typedef struct {
     hid_host_interface_event_cb_t callback;     /**< Callback invoked when HID Interface event occurs */
     void *callback_arg;                         /**< User provided argument passed to callback */
+    hid_host_input_report_cb_t report_callback; /**< Optional. When set, input reports are delivered here without a copy
+                                                     and HID_HOST_INTERFACE_EVENT_INPUT_REPORT is not sent to callback */
+    uint8_t in_xfer_num;                        /**< IN transfers kept queued on the interrupt endpoint, up to
+                                                     HID_HOST_IN_XFER_NUM_MAX. 0 selects HID_HOST_IN_XFER_NUM_DEFAULT */
 } hid_host_device_config_t;
 
 /**
@@ -174,6 +220,7 @@ esp_err_t hid_host_device_get_params(hid_host_device_handle_t hid_dev_handle,
  *
  * This functions should be called after HID Interface device event HID_HOST_INTERFACE_EVENT_INPUT_REPORT
  * to get the actual raw data of input report.
+ * Devices opened with hid_host_device_config_t::report_callback receive the data directly and do not need it.
  *
  * @param[in] hid_dev_handle    HID Device handle
  * @param[in] data              Pointer to buffer where the input data will be copied
@@ -187,6 +234,30 @@ esp_err_t hid_host_device_get_raw_input_report_data(hid_host_device_handle_t hid
         size_t data_length_max,
         size_t *data_length);
 
+/**
+ * @brief HID Host get interface input statistics by handle
+ *
+ * @param[in] hid_dev_handle    HID Device handle
+ * @param[out] stats            Pointer to a stats struct to fill
+ *
+ * @return esp_err_t
+ */
+esp_err_t hid_host_device_get_stats(hid_host_device_handle_t hid_dev_handle,
+                                    hid_host_dev_stats_t *stats);
+
+/**
+ * @brief HID Host get interface enumeration and last report timestamps by handle
+ *
+ * Cheap enough to call from the report callback, e.g. to timestamp the report being handled.
+ *
+ * @param[in] hid_dev_handle    HID Device handle
+ * @param[out] timing           Pointer to a timing struct to fill
+ *
+ * @return esp_err_t
+ */
+esp_err_t hid_host_device_get_timing(hid_host_device_handle_t hid_dev_handle,
+                                     hid_host_dev_timing_t *timing);
+
 // ------------------------ USB HID Host driver API ----------------------------
 
 /**
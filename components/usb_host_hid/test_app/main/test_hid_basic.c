@@ -667,6 +667,33 @@ TEST_CASE("sudden_disconnect", "[hid_host]")
     test_hid_teardown();
 }
 
+TEST_CASE("unplug_replug", "[hid_host]")
+{
+    // Install USB and HID driver with 'hid_host_test_concurrent', which keeps the handle
+    test_hid_setup(hid_host_test_concurrent, HID_TEST_EVENT_HANDLE_IN_DRIVER);
+    // Wait for USB device appearing for 250 msec
+    vTaskDelay(250);
+    hid_host_device_handle_t first_hdl = global_hdl;
+    TEST_ASSERT_NOT_NULL(first_hdl);
+
+    // Unplug: the interface must be closed and removed, so its handle no longer validates
+    hid_host_dev_params_t dev_params;
+    force_conn_state(false, 0);
+    vTaskDelay(250);
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, hid_host_device_get_params(first_hdl, &dev_params));
+
+    // Re-plug: the device enumerates again and gets a new handle
+    global_hdl = NULL;
+    force_conn_state(true, 0);
+    vTaskDelay(500);
+    TEST_ASSERT_NOT_NULL(global_hdl);
+    TEST_ASSERT_NOT_EQUAL(first_hdl, global_hdl);
+    TEST_ASSERT_EQUAL(ESP_OK, hid_host_device_get_params(global_hdl, &dev_params));
+    // Tear down test
+    test_hid_teardown();
+    // Verify the memory leackage during test environment tearDown()
+}
+
 TEST_CASE("mock_hid_device", "[hid_device][ignore]")
 {
     hid_mock_device(TUSB_IFACE_COUNT_ONE);
@@ -0,0 +1,84 @@
+"""Decode deferred log records (MSG_LOG) with the formats in main/dlog_formats.h.
+
+    python dlog_decode.py            # list the format table
+    python dlog_decode.py HEX...     # decode raw agv_msg_log_t payloads given as hex
+"""
+import os
+import re
+import struct
+import sys
+
+FORMATS_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), "main", "dlog_formats.h")
+LOG_MAX_ARGS = 4
+LOG_STR_MAX = 24
+LOG_PAYLOAD = struct.Struct(f"<HBB{LOG_MAX_ARGS}I{LOG_STR_MAX}s")    # fmt_id, nargs, str_len, args, str
+LEVEL_LETTERS = {"ESP_LOG_ERROR": "E", "ESP_LOG_WARN": "W", "ESP_LOG_INFO": "I",
+                 "ESP_LOG_DEBUG": "D", "ESP_LOG_VERBOSE": "V"}
+
+_FMT_LINE = re.compile(r'^\s*DLOG_FMT\(\s*(\w+)\s*,\s*(\w+)\s*,\s*"([^"]*)"\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+_SPEC = re.compile(r"%([-+ #0-9.]*)([a-zA-Z%])")
+
+
+def load_formats(path=FORMATS_H):
+    """Return [(id, level_letter, tag, format)] indexed by fmt_id."""
+    formats = []
+    with open(path) as header:
+        for line in header:
+            match = _FMT_LINE.match(line)
+            if match:
+                name, level, tag, fmt = match.groups()
+                formats.append((name, LEVEL_LETTERS.get(level, "?"), tag, fmt.encode().decode("unicode_escape")))
+    return formats
+
+
+def format_message(formats, fmt_id, nargs, str_len, args, text):
+    """Same output as dlog_format() on the AGV."""
+    if fmt_id >= len(formats):
+        return f"<unknown log format {fmt_id}>"
+    args = list(args[:nargs])
+    text = bytes(text[:str_len])
+
+    def convert(match):
+        flags, conv = match.groups()
+        if conv == "%":
+            return "%"
+        if conv == "s":
+            return text.decode(errors="replace")
+        if conv == "H":
+            return text.hex().upper()
+        if conv not in "diucxXo":
+            return match.group(0)
+        value = args.pop(0) if args else 0
+        if conv in "dic" and value >= 1 << 31:
+            value -= 1 << 32
+        return f"%{flags}{conv}" % value
+
+    return _SPEC.sub(convert, formats[fmt_id][3])
+
+
+def format_line(formats, timestamp_us, fields):
+    """ESP_LOGx style line for MSG_LOG fields (fmt_id, nargs, str_len, arg0..argN, str)."""
+    fmt_id, nargs, str_len = fields[:3]
+    args, text = fields[3:3 + LOG_MAX_ARGS], fields[3 + LOG_MAX_ARGS]
+    message = format_message(formats, fmt_id, nargs, str_len, args, text)
+    if fmt_id >= len(formats):
+        return message
+    _, letter, tag, _ = formats[fmt_id]
+    return f"{letter} ({timestamp_us // 1000}) {tag}: {message}"
+
+
+def main(argv):
+    formats = load_formats()
+    if len(argv) < 2:
+        for fmt_id, (name, letter, tag, fmt) in enumerate(formats):
+            print(f"{fmt_id:3d} {letter} {tag:<14} {name:<24} {fmt}")
+        return 0
+    for payload in argv[1:]:
+        fields = LOG_PAYLOAD.unpack(bytes.fromhex(payload))
+        print(format_message(formats, fields[0], fields[1], fields[2], fields[3:3 + LOG_MAX_ARGS],
+                             fields[3 + LOG_MAX_ARGS]))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,105 @@
+// clock_sync_bench_main.c
+// Feeds clock_sync_on_response() with exchanges against a simulated server whose
+// clock is offset and runs at a different rate, over a path with Wi-Fi style
+// queueing spikes in either direction, and checks how far clock_sync_fleet_us()
+// is from the true fleet time. Simulated time, so two hours run in milliseconds.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "clock_sync.h"
+
+#define BENCH_FLEET_START_US    1760000000000000ULL     // Late 2025, fleet time at local time 0
+#define BENCH_OFFSET_US         123456789LL             // On top of it, so the sign and size do not matter
+#define BENCH_DRIFT_PPB         40000                   // Local crystal 40 ppm slow
+#define BENCH_DURATION_US       (2ULL * 3600 * 1000000)
+#define BENCH_SETTLE_US         (5ULL * 60 * 1000000)   // Errors before this are not held against the filter
+#define BENCH_PATH_US           1500                    // One-way Wi-Fi latency without queueing
+#define BENCH_SPIKE_PCT         30                      // Share of one-way trips that wait in a queue
+#define BENCH_SPIKE_MAX_US      40000
+#define BENCH_MAX_ERROR_US      1000
+
+static int failures;
+static unsigned int seed = 0xC10C;
+
+static uint64_t bench_fleet(uint64_t local_us) {
+    return BENCH_FLEET_START_US + BENCH_OFFSET_US + local_us + (int64_t)local_us * BENCH_DRIFT_PPB / 1000000000LL;
+}
+
+static uint32_t bench_one_way(void) {
+    uint32_t us = BENCH_PATH_US + rand_r(&seed) % 200;
+    if (rand_r(&seed) % 100 < BENCH_SPIKE_PCT) us += rand_r(&seed) % BENCH_SPIKE_MAX_US;
+    return us;
+}
+
+// One exchange sent at local time t1, returns when the response arrived
+static uint64_t bench_exchange(uint64_t t1) {
+    const uint64_t server_rx = t1 + bench_one_way();
+    const uint64_t server_tx = server_rx + 100 + rand_r(&seed) % 2000;     // Python takes its time
+    const uint64_t t4 = server_tx + bench_one_way();
+    const agv_msg_time_resp_t resp = {
+        .echo_tx_us = t1,
+        .rx_us = bench_fleet(server_rx),
+    };
+    clock_sync_on_response(&resp, bench_fleet(server_tx), t4);
+    return t4;
+}
+
+static int bench_cmp_u64(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_check_rejects(void) {
+    clock_sync_stats_t before, after;
+    clock_sync_get_stats(&before);
+    // Response before the request, a server that answered before it received, a 300 ms round trip
+    const agv_msg_time_resp_t backwards = {.echo_tx_us = 2000, .rx_us = bench_fleet(1500)};
+    clock_sync_on_response(&backwards, bench_fleet(1600), 1000);
+    const agv_msg_time_resp_t hold = {.echo_tx_us = 1000, .rx_us = bench_fleet(1500)};
+    clock_sync_on_response(&hold, bench_fleet(1400), 2000);
+    const agv_msg_time_resp_t slow = {.echo_tx_us = 1000, .rx_us = bench_fleet(151000)};
+    clock_sync_on_response(&slow, bench_fleet(151100), 301000);
+    clock_sync_get_stats(&after);
+
+    const bool ok = after.rejected - before.rejected == 3 && !after.synced && clock_sync_fleet_us(5000) == 0;
+    if (!ok) failures++;
+    printf("rejects                  %" PRIu32 " of 3 rejected, %s %s\n", after.rejected - before.rejected,
+           after.synced ? "SYNCED" : "not synced", ok ? "ok" : "FAILED");
+}
+
+static void bench_check_tracking(void) {
+    static uint64_t errors[BENCH_DURATION_US / (CLOCK_SYNC_DEFAULT_PERIOD_MS * 1000ULL) + CLOCK_SYNC_SAMPLES];
+    int n = 0;
+    uint64_t first_sync_error = 0;
+    uint64_t t = 1000000;
+
+    for (int i = 0; t < BENCH_DURATION_US; i++) {
+        const uint64_t t4 = bench_exchange(t);
+        if (i == 0) first_sync_error = llabs((int64_t)(clock_sync_fleet_us(t4) - bench_fleet(t4)));
+
+        t += (i < CLOCK_SYNC_SAMPLES ? CLOCK_SYNC_FAST_PERIOD_MS : CLOCK_SYNC_DEFAULT_PERIOD_MS) * 1000ULL;
+        // Worst moment: just before the next exchange, on the rate estimate alone
+        const uint64_t probe = t - 1;
+        if (probe >= BENCH_SETTLE_US) errors[n++] = llabs((int64_t)(clock_sync_fleet_us(probe) - bench_fleet(probe)));
+    }
+
+    qsort(errors, n, sizeof(errors[0]), bench_cmp_u64);
+    clock_sync_stats_t stats;
+    clock_sync_get_stats(&stats);
+    const bool ok = stats.synced && n > 0 && errors[n - 1] <= BENCH_MAX_ERROR_US;
+    if (!ok) failures++;
+    printf("first exchange           error %" PRIu64 " us\n", first_sync_error);
+    printf("tracking                 n=%d error p50=%" PRIu64 "us p99=%" PRIu64 "us max=%" PRIu64 "us, "
+           "drift %" PRId32 " ppb (true %d), best round trip %" PRIu32 " us %s\n",
+           n, errors[n / 2], errors[n * 99 / 100], errors[n - 1], stats.drift_ppb, BENCH_DRIFT_PPB,
+           stats.best_delay_us, ok ? "ok" : "FAILED");
+}
+
+void app_main(void) {
+    // No clock_sync_init(): the bench plays both the request timer and the server
+    bench_check_rejects();
+    bench_check_tracking();
+    exit(failures ? 1 : 0);
+}
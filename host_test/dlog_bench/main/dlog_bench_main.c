@@ -0,0 +1,193 @@
+// dlog_bench_main.c
+// Checks that deferred log records format like the printf they replace, that the
+// per-core ring keeps each producer's records in order under contention and counts
+// what it drops, and compares the hot-path cost of a record with formatting and
+// writing the same ESP_LOGI line.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "dlog.h"
+
+#define BENCH_RECORDS       200000
+#define BENCH_THREADS       4
+#define BENCH_PER_THREAD    20000
+#define BENCH_BURST         16          // Records per producer between pauses, so the reader keeps up
+#define BENCH_UART_BAUD     115200
+#define BENCH_MAX_WRITE_NS  1000        // The point of the exercise: well under a microsecond
+
+static int failures;
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_expect(const char *what, const char *expected) {
+    dlog_entry_t entry;
+    char line[DLOG_LINE_MAX];
+    if (!dlog_read(&entry)) {
+        printf("FAIL %s: no record\n", what);
+        failures++;
+        return;
+    }
+    dlog_format(&entry.msg, line, sizeof(line));
+    if (strcmp(line, expected) != 0) {
+        printf("FAIL %s: \"%s\", expected \"%s\"\n", what, line, expected);
+        failures++;
+    }
+}
+
+static void bench_check_format(void) {
+    char expected[DLOG_LINE_MAX];
+    const char *tag = "E2003412DC03011812345678";
+    const uint8_t report[] = {0x01, 0xAB, 0x00, 0x7F};
+
+    DLOG_STR(DLOG_TAG_SENT, tag, 10);
+    bench_expect("string", "Sending RFID tag: E2003412DC");
+
+    DLOG(DLOG_MOUSE_REPORT, -12, 345, 'o', ' ');
+    snprintf(expected, sizeof(expected), "Mouse X:%06d Y:%06d |%c|%c|", -12, 345, 'o', ' ');
+    bench_expect("signed width", expected);
+
+    DLOG_STR(DLOG_GENERIC_REPORT, report, sizeof(report), sizeof(report));
+    bench_expect("hex", "Generic report, 4 bytes: 01AB007F");
+
+    DLOG_STR(DLOG_TAG_SEND_FAILED, tag, strlen(tag), 0x103);
+    snprintf(expected, sizeof(expected), "UDP send of tag %.*s failed: 0x103", AGV_LOG_STR_MAX, tag);
+    bench_expect("truncated string and hex", expected);
+
+    // Below the threshold nothing reaches the ring
+    dlog_stats_t before, after;
+    dlog_get_stats(&before);
+    dlog_set_level(ESP_LOG_INFO);
+    DLOG_STR(DLOG_TAG_REPEATED, tag, 10);
+    dlog_get_stats(&after);
+    dlog_entry_t entry;
+    if (after.written != before.written || dlog_read(&entry)) {
+        printf("FAIL level: a DEBUG record was kept at INFO\n");
+        failures++;
+    }
+    printf("format checks            %s\n", failures ? "FAILED" : "ok");
+}
+
+static void bench_check_overflow(void) {
+    dlog_stats_t before, after;
+    dlog_entry_t entry;
+    dlog_get_stats(&before);
+    for (uint32_t i = 0; i < DLOG_RING_SLOTS + 10; i++) DLOG(DLOG_MOUSE_REPORT, i, 0, ' ', ' ');
+    dlog_get_stats(&after);
+
+    uint32_t read = 0;
+    bool ordered = true;
+    while (dlog_read(&entry)) {
+        if (entry.msg.args[0] != read) ordered = false;
+        read++;
+    }
+    const uint32_t dropped = after.dropped - before.dropped;
+    const bool ok = read == DLOG_RING_SLOTS && dropped == 10 && ordered;
+    if (!ok) failures++;
+    printf("overflow                 %" PRIu32 " read, %" PRIu32 " dropped, %s %s\n", read, dropped,
+           ordered ? "in order" : "OUT OF ORDER", ok ? "ok" : "FAILED");
+}
+
+static int producers_done;
+
+static void *bench_producer(void *arg) {
+    const uint32_t id = (uint32_t)(uintptr_t)arg;
+    for (uint32_t i = 0; i < BENCH_PER_THREAD; i++) {
+        DLOG(DLOG_MOUSE_REPORT, id, i, ' ', ' ');
+        if (i % BENCH_BURST == BENCH_BURST - 1) usleep(50);
+    }
+    __atomic_fetch_add(&producers_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Several tasks on one core share its ring; each must see its own records in order
+static void bench_check_contention(void) {
+    pthread_t threads[BENCH_THREADS];
+    uint32_t next[BENCH_THREADS] = {0};
+    dlog_stats_t before, after;
+    dlog_entry_t entry;
+    uint32_t read = 0;
+    bool ordered = true;
+
+    dlog_get_stats(&before);
+    for (uintptr_t t = 0; t < BENCH_THREADS; t++) pthread_create(&threads[t], NULL, bench_producer, (void *)t);
+
+    for (;;) {
+        const bool finished = __atomic_load_n(&producers_done, __ATOMIC_ACQUIRE) == BENCH_THREADS;
+        while (dlog_read(&entry)) {
+            const uint32_t id = entry.msg.args[0], seq = entry.msg.args[1];
+            if (id >= BENCH_THREADS || seq < next[id]) ordered = false;
+            else next[id] = seq + 1;
+            read++;
+        }
+        if (finished) break;
+    }
+    for (int t = 0; t < BENCH_THREADS; t++) pthread_join(threads[t], NULL);
+    dlog_get_stats(&after);
+
+    const uint32_t written = after.written - before.written, dropped = after.dropped - before.dropped;
+    const bool ok = ordered && read == written && written + dropped == BENCH_THREADS * BENCH_PER_THREAD;
+    if (!ok) failures++;
+    printf("contention               %d producers, %" PRIu32 " read, %" PRIu32 " dropped, %s %s\n",
+           BENCH_THREADS, read, dropped, ordered ? "in order" : "OUT OF ORDER", ok ? "ok" : "FAILED");
+}
+
+static void bench_cost(void) {
+    const char *tag = "E2003412DC";
+    char line[DLOG_LINE_MAX];
+    dlog_entry_t entry;
+    FILE *null_out = fopen("/dev/null", "w");
+    if (!null_out) {
+        printf("Unable to open /dev/null\n");
+        failures++;
+        return;
+    }
+
+    // What ESP_LOGI does in the callback: format the whole line, then write it out
+    uint64_t start = bench_now_ns();
+    int line_len = 0;
+    for (int i = 0; i < BENCH_RECORDS; i++) {
+        line_len = snprintf(line, sizeof(line), "I (%" PRIu32 ") %s: Sending RFID tag: %s\n",
+                            (uint32_t)(bench_now_ns() / 1000000), "hid_keyboard", tag);
+        fwrite(line, 1, line_len, null_out);
+    }
+    const double printf_ns = (double)(bench_now_ns() - start) / BENCH_RECORDS;
+    fclose(null_out);
+
+    // Only the writes are timed, the formatter task drains between bursts
+    uint64_t write_ns = 0;
+    for (int done = 0; done < BENCH_RECORDS; done += DLOG_RING_SLOTS) {
+        start = bench_now_ns();
+        for (int i = 0; i < DLOG_RING_SLOTS; i++) DLOG_STR(DLOG_TAG_SENT, tag, 10);
+        write_ns += bench_now_ns() - start;
+        while (dlog_read(&entry)) dlog_format(&entry.msg, line, sizeof(line));
+    }
+    const double dlog_ns = (double)write_ns / BENCH_RECORDS;
+    const double uart_us = line_len * 10 * 1e6 / BENCH_UART_BAUD;
+
+    printf("log cost                 snprintf+write %.1f ns/line (plus %.0f us on a %d baud UART), "
+           "deferred %.1f ns/record\n", printf_ns, uart_us, BENCH_UART_BAUD, dlog_ns);
+    if (dlog_ns > BENCH_MAX_WRITE_NS) {
+        printf("FAIL deferred record costs more than %d ns\n", BENCH_MAX_WRITE_NS);
+        failures++;
+    }
+}
+
+void app_main(void) {
+    // No formatter task: the bench reads the rings itself
+    dlog_set_level(ESP_LOG_VERBOSE);
+    bench_check_format();
+    bench_check_overflow();
+    bench_check_contention();
+    bench_cost();
+    exit(failures ? 1 : 0);
+}
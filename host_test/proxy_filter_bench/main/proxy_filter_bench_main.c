@@ -0,0 +1,414 @@
+// proxy_filter_bench_main.c
+// Replays distance traces through proxy_filter and the old 23-25 inch window debounce,
+// and reports detection latency and false triggers against the noise-free reference.
+// Set PROXY_BENCH_TRACE to a file of little-endian uint16 pairs {measured_mm, reference_mm}
+// sampled every BENCH_PERIOD_US to replay a recorded trace instead of the synthetic one.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include "proxy_filter.h"
+#include "proxy_zone.h"
+
+#define BENCH_PERIOD_US     10000       // 100 Hz, the ultrasonic backend default
+#define BENCH_IDLE_PERIOD_US 50000      // 20 Hz, the ultrasonic backend while nothing is near
+#define BENCH_EPISODES      300
+#define BENCH_NO_ECHO       UINT16_MAX
+#define BENCH_MAX_RANGE_MM  4000
+
+// Old proxy_sensor_task window, 23-25 inches
+#define LEGACY_MIN_MM       584
+#define LEGACY_MAX_MM       635
+
+typedef struct {
+    uint16_t measured_mm;
+    uint16_t reference_mm;      // Noise-free distance, defines when a trigger is due
+} bench_sample_t;
+
+typedef struct {
+    size_t samples;
+    uint32_t episodes;          // Reference crossings of enter_mm
+    uint32_t detected;
+    uint32_t false_triggers;    // Triggers outside an episode, or repeated within one
+    uint64_t *latency_us;       // Per detected episode
+    uint64_t elapsed_ns;
+} bench_result_t;
+
+// Same thresholds for every detector, so results are comparable
+static const proxy_filter_config_t bench_filter_config = {
+    .median_window = 5,
+    .ema_shift = 2,
+    .enter_mm = 610,
+    .exit_mm = 700,
+    .min_dwell_us = 30000,
+    .max_range_mm = BENCH_MAX_RANGE_MM,
+    .max_dropouts = 3,
+};
+
+// proxy_sensor defaults
+static const proxy_zone_config_t bench_zone_config = {
+    .filter = {.median_window = 5, .ema_shift = 2, .max_range_mm = BENCH_MAX_RANGE_MM, .max_dropouts = 3},
+    .slow = {.enter_mm = 1200, .exit_mm = 1350, .min_dwell_us = 30000},
+    .stop = {.enter_mm = 610, .exit_mm = 700, .min_dwell_us = 30000},
+};
+
+typedef enum {
+    BENCH_RATE_CONSTANT = 0,    // Always BENCH_PERIOD_US
+    BENCH_RATE_ECHO,            // Idle until proxy_zone_active(), as proxy_sensor_task does
+    BENCH_RATE_ZONE,            // Idle until a zone leaves CLEAR
+} bench_rate_mode_t;
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double bench_uniform(unsigned int *seed) {
+    return rand_r(seed) / ((double)RAND_MAX + 1.0);
+}
+
+// Gaussian from Box-Muller, sigma in mm
+static double bench_noise(unsigned int *seed, double sigma) {
+    double u1 = bench_uniform(seed) + 1e-12, u2 = bench_uniform(seed);
+    return sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static size_t bench_push_segment(bench_sample_t *trace, size_t n, size_t cap, double from_mm, double to_mm,
+                                 double speed_mm_s, double hold_s, unsigned int *seed) {
+    size_t ramp = (size_t)(fabs(to_mm - from_mm) / speed_mm_s * 1e6 / BENCH_PERIOD_US) + 1;
+    size_t hold = (size_t)(hold_s * 1e6 / BENCH_PERIOD_US);
+
+    for (size_t i = 0; i < ramp + hold && n < cap; i++, n++) {
+        double ref = i < ramp ? from_mm + (to_mm - from_mm) * i / ramp : to_mm;
+        double measured = ref + bench_noise(seed, 15.0);
+        double roll = bench_uniform(seed);
+
+        trace[n].reference_mm = (uint16_t)ref;
+        if (roll < 0.02) {
+            trace[n].measured_mm = BENCH_NO_ECHO;   // Missed echo
+        } else if (roll < 0.03) {
+            trace[n].measured_mm = (uint16_t)(100 + bench_uniform(seed) * 3900);   // Multipath spike
+        } else {
+            trace[n].measured_mm = measured < 0 ? 0 : (uint16_t)measured;
+        }
+    }
+    return n;
+}
+
+// AGV approaches obstacles and stops, with near misses that never come within exit_mm
+static bench_sample_t *bench_make_trace(size_t *count, unsigned int *seed) {
+    const size_t cap = BENCH_EPISODES * 1000;
+    bench_sample_t *trace = malloc(cap * sizeof(*trace));
+    if (!trace) return NULL;
+
+    size_t n = 0;
+    for (int i = 0; i < BENCH_EPISODES; i++) {
+        double far = 1500 + bench_uniform(seed) * 1500;
+        double speed = 300 + bench_uniform(seed) * 1200;
+        double closest = (i % 3 == 2) ? 800 + bench_uniform(seed) * 400    // Near miss
+                                      : 300 + bench_uniform(seed) * 200;   // Stop at an obstacle
+        n = bench_push_segment(trace, n, cap, far, far, speed, 0.5 + bench_uniform(seed), seed);
+        n = bench_push_segment(trace, n, cap, far, closest, speed, 0.5 + bench_uniform(seed) * 1.5, seed);
+        n = bench_push_segment(trace, n, cap, closest, far, speed, 0, seed);
+    }
+    *count = n;
+    return trace;
+}
+
+static bench_sample_t *bench_load_trace(const char *path, size_t *count) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Unable to open trace %s: errno %d\n", path, errno);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    *count = size / sizeof(bench_sample_t);
+    bench_sample_t *trace = malloc(*count * sizeof(*trace));
+    if (trace && fread(trace, sizeof(*trace), *count, f) != *count) {
+        free(trace);
+        trace = NULL;
+    }
+    fclose(f);
+    return trace;
+}
+
+typedef bool (*bench_detector_fn_t)(void *state, uint16_t measured_mm, uint64_t timestamp_us);
+
+static bool bench_filter_detect(void *state, uint16_t measured_mm, uint64_t timestamp_us) {
+    return proxy_filter_update(state, measured_mm, timestamp_us) == PROXY_FILTER_ENTER;
+}
+
+static bool bench_legacy_detect(void *state, uint16_t measured_mm, uint64_t timestamp_us) {
+    bool *triggered_once_flag = state;
+    (void)timestamp_us;
+    if (measured_mm >= LEGACY_MIN_MM && measured_mm <= LEGACY_MAX_MM) {
+        if (!*triggered_once_flag) {
+            *triggered_once_flag = true;
+            return true;
+        }
+        return false;
+    }
+    *triggered_once_flag = false;
+    return false;
+}
+
+static void bench_run(bench_detector_fn_t detect, void *state, const bench_sample_t *trace, size_t count,
+                      bench_result_t *res) {
+    bool in_episode = false, detected = false;
+    uint64_t episode_start_us = 0;
+
+    memset(res, 0, sizeof(*res));
+    res->samples = count;
+    res->latency_us = malloc(count / 2 * sizeof(uint64_t) + sizeof(uint64_t));
+
+    uint64_t start = bench_now_ns();
+    for (size_t i = 0; i < count; i++) {
+        const uint64_t t = (uint64_t)i * BENCH_PERIOD_US;
+        const uint16_t ref = trace[i].reference_mm;
+
+        if (!in_episode && ref <= bench_filter_config.enter_mm) {
+            in_episode = true;
+            detected = false;
+            episode_start_us = t;
+            res->episodes++;
+        } else if (in_episode && ref >= bench_filter_config.exit_mm) {
+            in_episode = false;
+        }
+
+        if (detect(state, trace[i].measured_mm, t)) {
+            if (in_episode && !detected) {
+                detected = true;
+                res->latency_us[res->detected++] = t - episode_start_us;
+            } else {
+                res->false_triggers++;
+            }
+        }
+    }
+    res->elapsed_ns = bench_now_ns() - start;
+}
+
+static void bench_report(const char *name, bench_result_t *res) {
+    const double minutes = res->samples * (double)BENCH_PERIOD_US / 60e6;
+
+    printf("%-10s episodes=%u detected=%u false=%u (%.2f/min) ", name,
+           res->episodes, res->detected, res->false_triggers, res->false_triggers / minutes);
+    if (res->detected) {
+        qsort(res->latency_us, res->detected, sizeof(uint64_t), bench_cmp_u64);
+        printf("latency p50=%.0fms p90=%.0fms max=%.0fms ",
+               res->latency_us[res->detected / 2] / 1000.0,
+               res->latency_us[res->detected * 90 / 100] / 1000.0,
+               res->latency_us[res->detected - 1] / 1000.0);
+    }
+    printf("cost=%.1fns/sample\n", (double)res->elapsed_ns / res->samples);
+}
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+// Deterministic checks of each filter stage
+static int bench_unit_checks(void) {
+    int failures = 0;
+    proxy_filter_t filter;
+    proxy_filter_config_t config = bench_filter_config;
+    uint64_t t = 0;
+
+    // A single spike inside enter_mm never triggers
+    config.ema_shift = 0;
+    config.min_dwell_us = 0;
+    proxy_filter_init(&filter, &config);
+    for (int i = 0; i < 10; i++) CHECK(proxy_filter_update(&filter, 1500, t += BENCH_PERIOD_US) == PROXY_FILTER_NONE);
+    CHECK(proxy_filter_update(&filter, 100, t += BENCH_PERIOD_US) == PROXY_FILTER_NONE);
+    CHECK(proxy_filter_update(&filter, 1500, t += BENCH_PERIOD_US) == PROXY_FILTER_NONE);
+
+    // Short dropouts are ignored, a long run means nothing is in range
+    for (int i = 0; i < 3; i++) proxy_filter_update(&filter, BENCH_NO_ECHO, t += BENCH_PERIOD_US);
+    CHECK(filter.filtered_mm == 1500);
+    for (int i = 0; i < 5; i++) proxy_filter_update(&filter, BENCH_NO_ECHO, t += BENCH_PERIOD_US);
+    CHECK(filter.filtered_mm == BENCH_MAX_RANGE_MM);
+    // A run longer than the counter's range still counts as nothing in range
+    for (int i = 0; i < 300; i++) proxy_filter_update(&filter, BENCH_NO_ECHO, t += BENCH_PERIOD_US);
+    CHECK(filter.dropouts == config.max_dropouts);
+    CHECK(filter.filtered_mm == BENCH_MAX_RANGE_MM);
+
+    // Hysteresis: one ENTER, no re-trigger between enter_mm and exit_mm, EXIT at exit_mm
+    config = bench_filter_config;
+    config.median_window = 1;
+    config.ema_shift = 0;
+    config.min_dwell_us = 0;
+    proxy_filter_init(&filter, &config);
+    CHECK(proxy_filter_update(&filter, 600, t += BENCH_PERIOD_US) == PROXY_FILTER_ENTER);
+    CHECK(proxy_filter_update(&filter, 650, t += BENCH_PERIOD_US) == PROXY_FILTER_NONE);
+    CHECK(proxy_filter_update(&filter, 600, t += BENCH_PERIOD_US) == PROXY_FILTER_NONE);
+    CHECK(proxy_filter_update(&filter, 700, t += BENCH_PERIOD_US) == PROXY_FILTER_EXIT);
+    CHECK(proxy_filter_update(&filter, 600, t += BENCH_PERIOD_US) == PROXY_FILTER_ENTER);
+
+    // Dwell: each switch waits until the distance has been past the threshold for min_dwell_us
+    config.min_dwell_us = 3 * BENCH_PERIOD_US;
+    proxy_filter_init(&filter, &config);
+    CHECK(proxy_filter_update(&filter, 500, t += BENCH_PERIOD_US) == PROXY_FILTER_NONE);
+    CHECK(proxy_filter_update(&filter, 500, t += BENCH_PERIOD_US) == PROXY_FILTER_NONE);
+    CHECK(proxy_filter_update(&filter, 500, t += BENCH_PERIOD_US) == PROXY_FILTER_NONE);
+    CHECK(proxy_filter_update(&filter, 500, t += BENCH_PERIOD_US) == PROXY_FILTER_ENTER);
+    CHECK(proxy_filter_update(&filter, 800, t += BENCH_PERIOD_US) == PROXY_FILTER_NONE);
+    CHECK(proxy_filter_update(&filter, 500, t += BENCH_PERIOD_US) == PROXY_FILTER_NONE);
+    for (int i = 0; i < 3; i++) CHECK(proxy_filter_update(&filter, 800, t += BENCH_PERIOD_US) == PROXY_FILTER_NONE);
+    CHECK(proxy_filter_update(&filter, 800, t += BENCH_PERIOD_US) == PROXY_FILTER_EXIT);
+
+    // EMA converges to a constant input without fixed-point drift
+    config = bench_filter_config;
+    config.median_window = 1;
+    proxy_filter_init(&filter, &config);
+    proxy_filter_update(&filter, 2000, t += BENCH_PERIOD_US);
+    for (int i = 0; i < 100; i++) proxy_filter_update(&filter, 1234, t += BENCH_PERIOD_US);
+    CHECK(filter.filtered_mm == 1234);
+
+    printf("unit checks: %s\n", failures ? "FAILED" : "passed");
+    return failures;
+}
+
+// Zone fusion: worst channel wins, only zone changes are reported
+static int bench_zone_checks(void) {
+    int failures = 0;
+    proxy_zone_fusion_t fusion;
+    proxy_zone_change_t change;
+    proxy_zone_config_t config = {
+        .filter = {.median_window = 1, .max_range_mm = BENCH_MAX_RANGE_MM},
+        .slow = {.enter_mm = 1200, .exit_mm = 1350},
+        .stop = {.enter_mm = 610, .exit_mm = 700},
+    };
+    uint64_t t = 0;
+
+    proxy_zone_init(&fusion, &config);
+    CHECK(proxy_zone_add_channel(&fusion, 0, PROXY_ZONE_FRONT));
+    CHECK(proxy_zone_add_channel(&fusion, 1, PROXY_ZONE_FRONT));
+    CHECK(proxy_zone_add_channel(&fusion, 2, PROXY_ZONE_REAR));
+    CHECK(!proxy_zone_add_channel(&fusion, PROXY_ZONE_MAX_CHANNELS, PROXY_ZONE_FRONT));
+
+    CHECK(!proxy_zone_update(&fusion, 0, 2000, t += BENCH_PERIOD_US, &change));
+    CHECK(proxy_zone_update(&fusion, 0, 1000, t += BENCH_PERIOD_US, &change));
+    CHECK(change.zone == PROXY_ZONE_FRONT && change.state == PROXY_ZONE_SLOW && change.prev_state == PROXY_ZONE_CLEAR);
+    CHECK(proxy_zone_update(&fusion, 1, 500, t += BENCH_PERIOD_US, &change));
+    CHECK(change.state == PROXY_ZONE_STOP && change.sensor_id == 1 && change.distance_mm == 500);
+
+    // Channel 0 clearing does not clear the zone while channel 1 still sees an obstacle
+    CHECK(!proxy_zone_update(&fusion, 0, 2000, t += BENCH_PERIOD_US, &change));
+    CHECK(proxy_zone_update(&fusion, 1, 1000, t += BENCH_PERIOD_US, &change));
+    CHECK(change.state == PROXY_ZONE_SLOW && change.prev_state == PROXY_ZONE_STOP);
+    CHECK(proxy_zone_update(&fusion, 1, 2000, t += BENCH_PERIOD_US, &change));
+    CHECK(change.state == PROXY_ZONE_CLEAR);
+
+    // Zones are independent, unknown channels are ignored
+    CHECK(proxy_zone_update(&fusion, 2, 500, t += BENCH_PERIOD_US, &change));
+    CHECK(change.zone == PROXY_ZONE_REAR && change.state == PROXY_ZONE_STOP);
+    CHECK(fusion.zone_state[PROXY_ZONE_FRONT] == PROXY_ZONE_CLEAR);
+    CHECK(!proxy_zone_update(&fusion, 5, 500, t += BENCH_PERIOD_US, &change));
+
+    printf("zone checks: %s\n", failures ? "FAILED" : "passed");
+    return failures;
+}
+
+// Time from an obstacle appearing at 500 mm to STOP, with the ping rate switched as mode says.
+// The obstacle appears just after an idle ping, the worst case for the idle rate.
+static uint64_t bench_idle_start_latency(bench_rate_mode_t mode) {
+    const uint64_t appear_us = 1000000 + 1;
+    proxy_zone_fusion_t fusion;
+    proxy_zone_change_t change;
+    bool active = false;
+
+    proxy_zone_init(&fusion, &bench_zone_config);
+    proxy_zone_add_channel(&fusion, 0, PROXY_ZONE_FRONT);
+    for (uint64_t t = 0; t < 10 * appear_us;) {
+        const uint16_t distance = t < appear_us ? 3000 : 500;
+        if (proxy_zone_update(&fusion, 0, distance, t, &change) && change.state == PROXY_ZONE_STOP) {
+            return t - appear_us;
+        }
+        if (mode == BENCH_RATE_ECHO) active = proxy_zone_active(&fusion);
+        else if (mode == BENCH_RATE_ZONE) active = fusion.zone_state[PROXY_ZONE_FRONT] != PROXY_ZONE_CLEAR;
+        t += mode == BENCH_RATE_CONSTANT || active ? BENCH_PERIOD_US : BENCH_IDLE_PERIOD_US;
+    }
+    return UINT64_MAX;
+}
+
+// Starting at the idle rate may cost at most one idle period against a constant full rate
+static int bench_idle_start_checks(void) {
+    int failures = 0;
+    const uint64_t constant_us = bench_idle_start_latency(BENCH_RATE_CONSTANT);
+    const uint64_t echo_us = bench_idle_start_latency(BENCH_RATE_ECHO);
+    const uint64_t zone_us = bench_idle_start_latency(BENCH_RATE_ZONE);
+
+    CHECK(constant_us != UINT64_MAX);
+    CHECK(echo_us <= constant_us + BENCH_IDLE_PERIOD_US);
+    printf("idle start: STOP after constant=%.0fms echo=%.0fms zone=%.0fms, %s\n", constant_us / 1000.0,
+           echo_us / 1000.0, zone_us / 1000.0, failures ? "FAILED" : "passed");
+    return failures;
+}
+
+// Per-sample fusion cost must not grow with the number of channels
+static void bench_zone_cost(const bench_sample_t *trace, size_t count) {
+    proxy_zone_fusion_t fusion;
+    proxy_zone_change_t change;
+
+    for (int channels = 1; channels <= PROXY_ZONE_MAX_CHANNELS; channels *= 2) {
+        proxy_zone_init(&fusion, &bench_zone_config);
+        for (int c = 0; c < channels; c++) proxy_zone_add_channel(&fusion, c, (proxy_zone_id_t)(c % PROXY_ZONE_COUNT));
+
+        uint32_t changes = 0;
+        uint64_t start = bench_now_ns();
+        for (size_t i = 0; i < count; i++) {
+            // Round robin: channel c sees the trace shifted by c samples
+            int c = i % channels;
+            changes += proxy_zone_update(&fusion, c, trace[(i + c) % count].measured_mm,
+                                         (uint64_t)i * BENCH_PERIOD_US, &change);
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        printf("zones      channels=%d changes=%u cost=%.1fns/sample\n", channels, changes, (double)elapsed / count);
+    }
+}
+
+void app_main(void) {
+    unsigned int seed = 0xA6C;
+    int failed = bench_unit_checks();
+    failed |= bench_zone_checks();
+    failed |= bench_idle_start_checks();
+
+    size_t count = 0;
+    const char *path = getenv("PROXY_BENCH_TRACE");
+    bench_sample_t *trace = path ? bench_load_trace(path, &count) : bench_make_trace(&count, &seed);
+    if (!trace) {
+        fprintf(stderr, "No trace to replay\n");
+        exit(1);
+    }
+
+    proxy_filter_t filter;
+    proxy_filter_init(&filter, &bench_filter_config);
+    bool legacy_flag = false;
+    bench_result_t filter_res, legacy_res;
+
+    bench_run(bench_filter_detect, &filter, trace, count, &filter_res);
+    bench_run(bench_legacy_detect, &legacy_flag, trace, count, &legacy_res);
+
+    printf("\n---- proxy_filter_bench: %zu samples, %.1f min at %d Hz ----\n",
+           count, count * (double)BENCH_PERIOD_US / 60e6, 1000000 / BENCH_PERIOD_US);
+    bench_report("filter", &filter_res);
+    bench_report("legacy", &legacy_res);
+    bench_zone_cost(trace, count);
+
+    // The synthetic trace is generous enough that the filter must catch everything cleanly
+    if (!path) failed |= filter_res.detected != filter_res.episodes || filter_res.false_triggers != 0;
+
+    free(filter_res.latency_us);
+    free(legacy_res.latency_us);
+    free(trace);
+    exit(failed ? 1 : 0);
+}
@@ -0,0 +1,133 @@
+// decoder_bench.c
+// Reference copy of the original per-key decoder, kept only to benchmark rfid_frame against it.
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "rfid_frame.h"
+#include "decoder_bench.h"
+
+#define DECODER_BENCH_ROUNDS 50
+
+typedef struct {
+    uint32_t tags;
+    uint32_t hash;
+} decoder_result_t;
+
+static const uint8_t keycode2ascii[57][2] = {
+    {0, 0},{0, 0},{0, 0},{0, 0},
+    {'a','A'},{'b','B'},{'c','C'},{'d','D'},{'e','E'},
+    {'f','F'},{'g','G'},{'h','H'},{'i','I'},{'j','J'},
+    {'k','K'},{'l','L'},{'m','M'},{'n','N'},{'o','O'},
+    {'p','P'},{'q','Q'},{'r','R'},{'s','S'},{'t','T'},
+    {'u','U'},{'v','V'},{'w','W'},{'x','X'},{'y','Y'},
+    {'z','Z'},{'1','!'},{'2','@'},{'3','#'},{'4','$'},
+    {'5','%'},{'6','^'},{'7','&'},{'8','*'},{'9','('},
+    {'0',')'},{'\r','\r'},
+    {0,0},{'\b',0},{0,0},{' ',' '},{'-','_'},{'=','+'},
+    {'[','{'},{']','}'},{'\\','|'},{'\\','|'},
+    {';',':'},{'\'','\"'},{'`','~'},{',','<'},{'.','>'},{'/','?'}
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// FNV-1a over every emitted tag, so both decoders can be checked for identical output
+static void result_add_tag(decoder_result_t *res, const char *tag, size_t len) {
+    uint32_t h = res->hash ? res->hash : 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (uint8_t)tag[i]) * 16777619u;
+    res->hash = (h ^ '\n') * 16777619u;
+    res->tags++;
+}
+
+/* ------------ Legacy decoder ------------ */
+
+typedef struct {
+    char buffer[RFID_BUFFER_SIZE];
+    int index;
+    uint8_t prev_keys[HID_KEYBOARD_KEY_MAX];
+} legacy_state_t;
+
+static inline bool legacy_key_found(const uint8_t *src, uint8_t key, unsigned int length) {
+    for (unsigned int i=0;i<length;i++) if (src[i] == key) return true;
+    return false;
+}
+
+static inline bool legacy_get_char(uint8_t modifier, uint8_t key_code, unsigned char *key_char) {
+    uint8_t mod = ((modifier & HID_LEFT_SHIFT) || (modifier & HID_RIGHT_SHIFT)) ? 1 : 0;
+    if ((key_code >= HID_KEY_A) && (key_code <= HID_KEY_SLASH)) {
+        *key_char = keycode2ascii[key_code][mod];
+    } else return false;
+    return true;
+}
+
+static void legacy_key_pressed(legacy_state_t *st, uint8_t modifier, uint8_t key_code, decoder_result_t *res) {
+    unsigned char key_char;
+    if (!legacy_get_char(modifier, key_code, &key_char) || !key_char) return;
+    if (key_char == '\r') {
+        st->buffer[st->index] = '\0';
+        if (st->index > 0) result_add_tag(res, st->buffer, st->index);
+        st->index = 0;
+        memset(st->buffer, 0, RFID_BUFFER_SIZE);
+    } else if (st->index < RFID_BUFFER_SIZE - 1) {
+        st->buffer[st->index++] = key_char;
+    }
+}
+
+// noinline: rfid_frame_feed_report lives in another file, keep the call overhead comparable
+__attribute__((noinline)) static void legacy_feed_report(legacy_state_t *st, const hid_keyboard_input_report_boot_t *kb_report,
+                               decoder_result_t *res) {
+    for (int i = 0; i < HID_KEYBOARD_KEY_MAX; i++) {
+        if (kb_report->key[i] > HID_KEY_ERROR_UNDEFINED &&
+            !legacy_key_found(st->prev_keys, kb_report->key[i], HID_KEYBOARD_KEY_MAX)) {
+            legacy_key_pressed(st, kb_report->modifier.val, kb_report->key[i], res);
+        }
+    }
+    memcpy(st->prev_keys, &kb_report->key, HID_KEYBOARD_KEY_MAX);
+}
+
+/* ------------ Benchmark ------------ */
+
+static void frame_on_tag(const char *tag, size_t len, void *arg) {
+    result_add_tag((decoder_result_t *)arg, tag, len);
+}
+
+int decoder_bench_run(const char *name, const hid_keyboard_input_report_boot_t *reports, size_t count) {
+    decoder_result_t legacy_res = {0}, lut_res = {0};
+    uint64_t legacy_ns = 0, lut_ns = 0;
+
+    for (int round = 0; round < DECODER_BENCH_ROUNDS; round++) {
+        legacy_state_t legacy = {0};
+        decoder_result_t res = {0};
+        uint64_t t0 = now_ns();
+        for (size_t i = 0; i < count; i++) legacy_feed_report(&legacy, &reports[i], &res);
+        legacy_ns += now_ns() - t0;
+        legacy_res = res;
+    }
+
+    for (int round = 0; round < DECODER_BENCH_ROUNDS; round++) {
+        rfid_frame_t frame;
+        decoder_result_t res = {0};
+        rfid_frame_init(&frame, frame_on_tag, &res);
+        uint64_t t0 = now_ns();
+        for (size_t i = 0; i < count; i++) {
+            rfid_frame_feed_report(&frame, (const uint8_t *)&reports[i], sizeof(reports[i]));
+        }
+        lut_ns += now_ns() - t0;
+        lut_res = res;
+    }
+
+    const double reports_total = (double)count * DECODER_BENCH_ROUNDS;
+    printf("%-24s legacy %.1f ns/report, lut+bitmap %.1f ns/report (%u tags)\n",
+           name, legacy_ns / reports_total, lut_ns / reports_total, lut_res.tags);
+
+    if (legacy_res.tags != lut_res.tags || legacy_res.hash != lut_res.hash) {
+        printf("%s: decoder mismatch: legacy %08x, lut %08x\n", name, (unsigned)legacy_res.hash, (unsigned)lut_res.hash);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+#include "usb/hid_usage_keyboard.h"
+
+/**
+ * @brief Compare the legacy keycode2ascii/key_found decoder against rfid_frame on the same reports
+ *
+ * @param name    Label printed with the results
+ * @param reports Report stream, e.g. captured from a reader
+ * @param count   Number of reports
+ * @return 0 when both decoders produced the same tags, 1 otherwise
+ */
+int decoder_bench_run(const char *name, const hid_keyboard_input_report_boot_t *reports, size_t count);
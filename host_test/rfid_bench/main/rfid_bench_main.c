@@ -0,0 +1,414 @@
+// rfid_bench_main.c
+// Feeds synthetic boot-keyboard reports through hid_host_keyboard_report_callback
+// and measures per-tag decode-to-sendto latency (through the urgent uplink path)
+// and tag throughput on the host.
+// A second pass re-reads a few tags many times, as a reader does while the AGV
+// sits on a marker, and checks that only the first read of each is sent.
+// A third pass drops the first copy of some tags and checks that the
+// retransmit path still gets every tag acknowledged, and a fourth takes the
+// link down so tags pile up in the offline store, then checks they all reach
+// the server in order once it is back.
+// Set RFID_BENCH_CAPTURE to a file of raw 8-byte boot reports to run the decoder
+// comparison on captured reader traffic instead of the synthetic tags.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "usb/hid_usage_keyboard.h"
+#include "hid_keyboard.h"
+#include "rfid_frame.h"
+#include "agv_proto.h"
+#include "udp_uplink.h"
+#include "udp_reliable.h"
+#include "udp_store.h"
+#include "tag_dedup.h"
+#include "metrics.h"
+#include "decoder_bench.h"
+
+#define BENCH_TAG_COUNT     2000
+#define BENCH_TAG_MIN_LEN   10
+#define BENCH_TAG_MAX_LEN   14
+#define BENCH_MAX_REPORTS   (2 * (BENCH_TAG_MAX_LEN + 1))
+#define BENCH_DWELL_TAGS    50      // Markers visited in the dwell pass
+#define BENCH_DWELL_READS   20      // Reads of each marker while parked on it
+#define BENCH_LOSS_TAGS     48      // Tags in the loss pass, back to back
+#define BENCH_LOSS_EVERY    4       // One in this many loses its first copy, 12 stay within the window
+#define BENCH_LOSS_WAIT_NS  2000000000ULL
+#define BENCH_OFFLINE_TAGS  200     // Read during the outage, more than the retransmit window
+
+typedef struct {
+    hid_keyboard_input_report_boot_t reports[BENCH_MAX_REPORTS];
+    int num_reports;
+} bench_tag_t;
+
+static bench_tag_t bench_tags[BENCH_TAG_COUNT];
+static int udp_sock = -1;
+static struct sockaddr_in pc_addr;
+static uint64_t latency_ns[BENCH_TAG_COUNT];
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_push_key(bench_tag_t *tag, uint8_t modifier, uint8_t key_code) {
+    hid_keyboard_input_report_boot_t *press = &tag->reports[tag->num_reports++];
+    memset(press, 0, sizeof(*press));
+    press->modifier.val = modifier;
+    press->key[0] = key_code;
+    // Reader releases every key before pressing the next one
+    memset(&tag->reports[tag->num_reports++], 0, sizeof(*press));
+}
+
+// Tag characters match what our readers emit: uppercase hex digits
+static void bench_make_tag(bench_tag_t *tag, unsigned int *seed) {
+    static const char alphabet[] = "0123456789ABCDEF";
+    int len = BENCH_TAG_MIN_LEN + rand_r(seed) % (BENCH_TAG_MAX_LEN - BENCH_TAG_MIN_LEN + 1);
+    tag->num_reports = 0;
+    for (int i = 0; i < len; i++) {
+        char c = alphabet[rand_r(seed) % (sizeof(alphabet) - 1)];
+        if (c >= 'A' && c <= 'Z') bench_push_key(tag, HID_LEFT_SHIFT, HID_KEY_A + (c - 'A'));
+        else if (c == '0') bench_push_key(tag, 0, HID_KEY_0);
+        else bench_push_key(tag, 0, HID_KEY_1 + (c - '1'));
+    }
+    bench_push_key(tag, 0, HID_KEY_ENTER);
+}
+
+// Returns a heap array of reports, either read from RFID_BENCH_CAPTURE or flattened from bench_tags
+static hid_keyboard_input_report_boot_t *bench_load_reports(size_t *count) {
+    const char *path = getenv("RFID_BENCH_CAPTURE");
+    hid_keyboard_input_report_boot_t *reports = NULL;
+
+    if (path) {
+        FILE *f = fopen(path, "rb");
+        if (!f) {
+            fprintf(stderr, "Unable to open capture %s: errno %d\n", path, errno);
+            return NULL;
+        }
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        *count = size / sizeof(*reports);
+        reports = malloc(*count * sizeof(*reports));
+        if (reports && fread(reports, sizeof(*reports), *count, f) != *count) {
+            free(reports);
+            reports = NULL;
+        }
+        fclose(f);
+        return reports;
+    }
+
+    *count = 0;
+    for (int i = 0; i < BENCH_TAG_COUNT; i++) *count += bench_tags[i].num_reports;
+    reports = malloc(*count * sizeof(*reports));
+    if (!reports) return NULL;
+    size_t n = 0;
+    for (int i = 0; i < BENCH_TAG_COUNT; i++) {
+        memcpy(&reports[n], bench_tags[i].reports, bench_tags[i].num_reports * sizeof(*reports));
+        n += bench_tags[i].num_reports;
+    }
+    return reports;
+}
+
+// Worst case for the old O(n^2) key diff: all six slots held, one key replaced per report
+static hid_keyboard_input_report_boot_t *bench_make_rollover(size_t count, unsigned int *seed) {
+    hid_keyboard_input_report_boot_t *reports = calloc(count, sizeof(*reports));
+    if (!reports) return NULL;
+    uint8_t held[HID_KEYBOARD_KEY_MAX] = {HID_KEY_A, HID_KEY_B, HID_KEY_C, HID_KEY_D, HID_KEY_E, HID_KEY_F};
+    for (size_t i = 0; i < count; i++) {
+        held[i % HID_KEYBOARD_KEY_MAX] = HID_KEY_A + rand_r(seed) % (HID_KEY_0 - HID_KEY_A + 1);
+        if (i % 64 == 63) held[i % HID_KEYBOARD_KEY_MAX] = HID_KEY_ENTER;
+        memcpy(reports[i].key, held, sizeof(held));
+    }
+    return reports;
+}
+
+static int bench_open_sink(void) {
+    int sink = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sink < 0) return -1;
+
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = 0};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (bind(sink, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(sink, (struct sockaddr *)&addr, &addr_len) < 0) {
+        close(sink);
+        return -1;
+    }
+    fcntl(sink, F_SETFL, O_NONBLOCK);
+
+    // Point the uplink sink at the loopback socket
+    pc_addr = addr;
+    return sink;
+}
+
+// Uplink sink: the firmware uses udp_service_send, which needs lwIP and the transport task.
+// Stamps tx_us the same way, so the ACKs carry it back.
+static int bench_uplink_send(const char *data, size_t len) {
+    static uint8_t buf[AGV_PROTO_MAX_DGRAM];
+    if (len > sizeof(buf)) return -1;
+    memcpy(buf, data, len);
+    agv_proto_stamp_tx(buf, len, agv_proto_now_us());
+    return sendto(udp_sock, buf, len, 0, (struct sockaddr *)&pc_addr, sizeof(pc_addr));
+}
+
+// Tags seen by the stand-in server, to check the order stored tags arrive in
+typedef struct {
+    uint32_t tags;
+    uint32_t last_seq;
+    bool out_of_order;
+} bench_server_t;
+
+// Datagram being acknowledged: its tx_us and when the stand-in server received it
+static uint64_t bench_dgram_tx_us, bench_dgram_rx_us;
+
+// Stands in for the fleet server: acknowledge every tag in the datagram
+static void bench_ack_msg(const agv_proto_msg_hdr_t *hdr, const void *payload, void *arg) {
+    bench_server_t *server = arg;
+    if (hdr->type != AGV_MSG_TAG) return;
+    const agv_msg_ack_t ack = {
+        .base_seq = hdr->seq,
+        .mask = 1,
+        .echo_tx_us = bench_dgram_tx_us,
+        .rx_us = bench_dgram_rx_us,
+    };
+    udp_reliable_on_ack(&ack, agv_proto_now_us());
+    if (server) {
+        if (server->tags && (int32_t)(hdr->seq - server->last_seq) <= 0) server->out_of_order = true;
+        server->last_seq = hdr->seq;
+        server->tags++;
+    }
+}
+
+// Returns the number of datagrams received; with ack unset they count as lost
+static int bench_drain_sink(int sink, bool ack, bench_server_t *server) {
+    uint8_t buf[AGV_PROTO_MAX_DGRAM];
+    int received = 0;
+    ssize_t len;
+    while ((len = recv(sink, buf, sizeof(buf), 0)) > 0) {
+        if (ack) {
+            bench_dgram_rx_us = agv_proto_now_us();
+            bench_dgram_tx_us = agv_proto_dgram_tx_us(buf, (size_t)len);
+            agv_proto_parse(buf, (size_t)len, bench_ack_msg, server);
+        }
+        received++;
+    }
+    return received;
+}
+
+static void bench_report(const char *name, uint64_t *samples, int count, uint64_t total_ns) {
+    qsort(samples, count, sizeof(samples[0]), bench_cmp_u64);
+    printf("%-24s n=%d p50=%.2fus p90=%.2fus p99=%.2fus max=%.2fus rate=%.0f tags/s\n",
+           name, count,
+           samples[count / 2] / 1000.0,
+           samples[count * 90 / 100] / 1000.0,
+           samples[count * 99 / 100] / 1000.0,
+           samples[count - 1] / 1000.0,
+           count / (total_ns / 1e9));
+}
+
+// Window expiry and eviction on a private set, with synthetic timestamps
+static int bench_check_dedup(void) {
+    static tag_dedup_t dedup;
+    int failed = 0;
+
+    tag_dedup_init(&dedup, 1000);
+    failed |= !tag_dedup_check(&dedup, "04A1B2C3D4", 10, 0);
+    failed |= tag_dedup_check(&dedup, "04A1B2C3D4", 10, 999);
+    // Still refreshed by the suppressed read, so 1500 is within the window
+    failed |= tag_dedup_check(&dedup, "04A1B2C3D4", 10, 1500);
+    failed |= !tag_dedup_check(&dedup, "04A1B2C3D4", 10, 2500);
+    failed |= !tag_dedup_check(&dedup, "04A1B2C3D5", 10, 2500);
+
+    // Far more live tags than slots: each is forwarded and the set keeps working
+    tag_dedup_init(&dedup, 1000000);
+    char tag[16];
+    for (int i = 0; i < 4 * TAG_DEDUP_CAPACITY; i++) {
+        int len = snprintf(tag, sizeof(tag), "TAG%05d", i);
+        failed |= !tag_dedup_check(&dedup, tag, len, i);
+    }
+    failed |= dedup.stats.evicted == 0;
+    failed |= tag_dedup_check(&dedup, tag, strlen(tag), 4 * TAG_DEDUP_CAPACITY);
+
+    printf("dedup checks: %s\n", failed ? "FAILED" : "ok");
+    return failed;
+}
+
+void app_main(void) {
+    unsigned int seed = 0xA6B;
+    for (int i = 0; i < BENCH_TAG_COUNT; i++) bench_make_tag(&bench_tags[i], &seed);
+
+    int sink = bench_open_sink();
+    udp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sink < 0 || udp_sock < 0) {
+        fprintf(stderr, "Unable to create loopback sockets: errno %d\n", errno);
+        exit(1);
+    }
+    const udp_store_config_t store_config = {.send = bench_uplink_send};
+    const udp_uplink_config_t uplink_config = {.send = udp_store_send};
+    if (udp_store_init(&store_config) != ESP_OK || udp_uplink_init(&uplink_config) != ESP_OK ||
+        udp_reliable_init(NULL) != ESP_OK) {
+        fprintf(stderr, "Unable to start the UDP uplink\n");
+        exit(1);
+    }
+    udp_store_set_online(true);
+    udp_reliable_set_paused(false);
+
+    int delivered = 0;
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < BENCH_TAG_COUNT; i++) {
+        const bench_tag_t *tag = &bench_tags[i];
+        uint64_t t0 = bench_now_ns();
+        for (int r = 0; r < tag->num_reports; r++) {
+            hid_host_keyboard_report_callback((const uint8_t *)&tag->reports[r],
+                                              sizeof(hid_keyboard_input_report_boot_t), agv_proto_now_us());
+        }
+        latency_ns[i] = bench_now_ns() - t0;
+        delivered += bench_drain_sink(sink, true, NULL);
+    }
+    uint64_t total = bench_now_ns() - start;
+
+    // Parked on each marker in turn, well within the window
+    hid_keyboard_set_tag_window(0);
+    tag_dedup_stats_t before;
+    hid_keyboard_get_tag_stats(&before);
+    int dwell_delivered = 0;
+    for (int i = 0; i < BENCH_DWELL_TAGS; i++) {
+        const bench_tag_t *tag = &bench_tags[i];
+        for (int n = 0; n < BENCH_DWELL_READS; n++) {
+            for (int r = 0; r < tag->num_reports; r++) {
+                hid_host_keyboard_report_callback((const uint8_t *)&tag->reports[r],
+                                                  sizeof(hid_keyboard_input_report_boot_t), agv_proto_now_us());
+            }
+        }
+        dwell_delivered += bench_drain_sink(sink, true, NULL);
+    }
+    tag_dedup_stats_t tag_stats;
+    hid_keyboard_get_tag_stats(&tag_stats);
+    const uint32_t dwell_suppressed = tag_stats.suppressed - before.suppressed;
+    const int dwell_failed = dwell_delivered != BENCH_DWELL_TAGS ||
+                             dwell_suppressed != BENCH_DWELL_TAGS * (BENCH_DWELL_READS - 1);
+
+    // Lossy link: unacknowledged first copies have to be recovered by the retransmit timer
+    hid_keyboard_set_tag_window(0);
+    udp_reliable_stats_t rel_before, rel;
+    udp_reliable_get_stats(&rel_before);
+    int lost = 0;
+    for (int i = 0; i < BENCH_LOSS_TAGS; i++) {
+        const bench_tag_t *tag = &bench_tags[BENCH_DWELL_TAGS + i];
+        for (int r = 0; r < tag->num_reports; r++) {
+            hid_host_keyboard_report_callback((const uint8_t *)&tag->reports[r],
+                                              sizeof(hid_keyboard_input_report_boot_t), agv_proto_now_us());
+        }
+        const bool drop = i % BENCH_LOSS_EVERY == 0;
+        const int received = bench_drain_sink(sink, !drop, NULL);
+        if (drop) lost += received;
+    }
+    const uint64_t loss_start = bench_now_ns();
+    do {
+        usleep(1000);
+        bench_drain_sink(sink, true, NULL);
+        udp_reliable_get_stats(&rel);
+    } while (rel.acked - rel_before.acked < BENCH_LOSS_TAGS && bench_now_ns() - loss_start < BENCH_LOSS_WAIT_NS);
+    const uint64_t recovery_ns = bench_now_ns() - loss_start;
+    const int loss_failed = rel.acked - rel_before.acked != BENCH_LOSS_TAGS || rel.expired != rel_before.expired ||
+                            rel.window_full != rel_before.window_full ||
+                            rel.retransmits - rel_before.retransmits < (uint32_t)lost;
+
+    // Wi-Fi outage: nothing may reach the server until the link is back, then everything in order
+    udp_store_set_online(false);
+    udp_reliable_set_paused(true);
+    hid_keyboard_set_tag_window(0);
+    int offline_leaked = 0;
+    for (int i = 0; i < BENCH_OFFLINE_TAGS; i++) {
+        const bench_tag_t *tag = &bench_tags[BENCH_DWELL_TAGS + BENCH_LOSS_TAGS + i];
+        for (int r = 0; r < tag->num_reports; r++) {
+            hid_host_keyboard_report_callback((const uint8_t *)&tag->reports[r],
+                                              sizeof(hid_keyboard_input_report_boot_t), agv_proto_now_us());
+        }
+        offline_leaked += bench_drain_sink(sink, true, NULL);
+    }
+    udp_store_stats_t store_stats;
+    udp_store_get_stats(&store_stats);
+    const uint32_t offline_stored = store_stats.depth;
+
+    bench_server_t server = {0};
+    const uint64_t online_start = bench_now_ns();
+    udp_store_set_online(true);
+    udp_reliable_set_paused(false);
+    do {
+        usleep(1000);
+        bench_drain_sink(sink, true, &server);
+        udp_store_get_stats(&store_stats);
+    } while ((store_stats.depth || server.tags < BENCH_OFFLINE_TAGS) && bench_now_ns() - online_start < BENCH_LOSS_WAIT_NS);
+    const uint64_t drain_ns = bench_now_ns() - online_start;
+    udp_reliable_get_stats(&rel);
+    const int offline_failed = offline_leaked || server.tags != BENCH_OFFLINE_TAGS || server.out_of_order ||
+                               store_stats.dropped;
+
+    printf("\n---- rfid_bench ----\n");
+    bench_report("keyboard_report->sendto", latency_ns, BENCH_TAG_COUNT, total);
+    printf("delivered %d/%d datagrams\n", delivered, BENCH_TAG_COUNT);
+    printf("dwell: %d reads, %d sent, %" PRIu32 " suppressed\n",
+           BENCH_DWELL_TAGS * BENCH_DWELL_READS, dwell_delivered, dwell_suppressed);
+    const int dedup_failed = dwell_failed | bench_check_dedup();
+    printf("loss: %d tags, %d first copies dropped, %" PRIu32 " retransmits, all acked %.1f ms later: %s\n",
+           BENCH_LOSS_TAGS, lost, rel.retransmits - rel_before.retransmits, recovery_ns / 1e6,
+           loss_failed ? "FAILED" : "ok");
+    printf("offline: %d tags stored as %" PRIu32 " datagrams, %" PRIu32 " tags drained %s in %.1f ms: %s\n",
+           BENCH_OFFLINE_TAGS, offline_stored, server.tags, server.out_of_order ? "out of order" : "in order",
+           drain_ns / 1e6, offline_failed ? "FAILED" : "ok");
+    printf("store: %" PRIu32 " stored, %" PRIu32 " forwarded, %" PRIu32 " dropped, max depth %" PRIu32 "\n",
+           store_stats.stored, store_stats.forwarded, store_stats.dropped, store_stats.max_depth);
+    printf("reliable: %" PRIu32 " sent, %" PRIu32 " acked, %" PRIu32 " expired, rtt %" PRIu32 " us (max %" PRIu32 " us)\n",
+           rel.sent, rel.acked, rel.expired, rel.last_rtt_us, rel.max_rtt_us);
+
+    // Every acknowledged tag is traced; the stages only have to be there, the host times are meaningless
+    static agv_msg_metrics_t counters;
+    static agv_msg_histogram_t hist[METRIC_HISTOGRAM_COUNT];
+    metrics_snapshot(&counters, hist);
+    uint32_t traced = 0;
+    for (int b = 0; b < AGV_HIST_BUCKETS; b++) traced += hist[METRIC_TAG_QUEUE_US].buckets[b];
+    const int trace_failed = traced != rel.acked;
+    printf("trace: %" PRIu32 " tags timed, max usb %" PRIu32 " us, decode %" PRIu32 " us, queue %" PRIu32
+           " us, wifi %" PRIu32 " us, server %" PRIu32 " us: %s\n", traced, hist[METRIC_TAG_USB_US].max_us,
+           hist[METRIC_TAG_DECODE_US].max_us, hist[METRIC_TAG_QUEUE_US].max_us, hist[METRIC_TAG_WIFI_US].max_us,
+           hist[METRIC_TAG_SERVER_US].max_us, trace_failed ? "FAILED" : "ok");
+
+    udp_uplink_stats_t uplink_stats;
+    udp_uplink_get_stats(&uplink_stats);
+    printf("uplink: %" PRIu32 " events in %" PRIu32 " datagrams, %" PRIu32 " send errors\n",
+           uplink_stats.events, uplink_stats.datagrams, uplink_stats.send_errors);
+
+    size_t report_count = 0;
+    hid_keyboard_input_report_boot_t *reports = bench_load_reports(&report_count);
+    int decoder_failed = reports ? decoder_bench_run("decode tags", reports, report_count) : 1;
+    free(reports);
+
+    report_count = 64 * 1024;
+    reports = bench_make_rollover(report_count, &seed);
+    decoder_failed |= reports ? decoder_bench_run("decode 6-key rollover", reports, report_count) : 1;
+    free(reports);
+
+    udp_reliable_deinit();
+    udp_uplink_deinit();
+    udp_store_deinit();
+    close(udp_sock);
+    close(sink);
+    exit((delivered == BENCH_TAG_COUNT && !decoder_failed && !dedup_failed && !loss_failed && !offline_failed &&
+          !trace_failed) ? 0 : 1);
+}
@@ -0,0 +1,149 @@
+// actuator.c
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "actuator.h"
+#include "agv_proto.h"
+
+// Change this to your board's embedded LED GPIO
+#define GREEN_LED_PIN 13
+
+#define ACTUATOR_RETRY_US 1000  // Until a command holding the lock lets go
+
+typedef struct {
+    gpio_num_t gpio;
+    esp_timer_handle_t timer;
+    actuator_step_t steps[ACTUATOR_MAX_STEPS];
+    size_t num_steps;
+    size_t step;
+    uint8_t repeat_left;
+    bool running;               // Waiting for a step to end
+    actuator_stats_t stats;
+} actuator_t;
+
+static const char *TAG = "actuator";
+
+static SemaphoreHandle_t s_lock;    // Guards s_actuators, commands and timer callbacks race
+static actuator_t s_actuators[ACTUATOR_COUNT] = {
+    [ACTUATOR_LED_GREEN] = {.gpio = GREEN_LED_PIN},
+};
+
+// Apply the current step and arm the timer for its end; call with s_lock held
+static void actuator_apply_step(actuator_t *act) {
+    const actuator_step_t *step = &act->steps[act->step];
+    gpio_set_level(act->gpio, step->level);
+    act->running = step->duration_ms != 0;
+    if (act->running) {
+        // Replaces a retry the callback armed while this held the lock
+        while (esp_timer_start_once(act->timer, step->duration_ms * 1000ULL) == ESP_ERR_INVALID_STATE) {
+            esp_timer_stop(act->timer);
+        }
+    }
+}
+
+// Runs in the esp_timer task and never blocks there: with the lock busy it fires again shortly.
+// A command holding the lock meanwhile re-arms the timer over that retry, see actuator_apply_step().
+static void actuator_step_expired(void *arg) {
+    actuator_t *act = arg;
+
+    if (xSemaphoreTake(s_lock, 0) != pdTRUE) {
+        esp_timer_start_once(act->timer, ACTUATOR_RETRY_US);
+        return;
+    }
+    // A command between the timer firing and the lock leaves the timer armed again
+    if (act->running && !esp_timer_is_active(act->timer)) {
+        if (++act->step == act->num_steps) {
+            act->step = 0;
+            if (act->repeat_left == 0) {
+                act->running = false;
+                xSemaphoreGive(s_lock);
+                return;
+            }
+            act->repeat_left--;
+        }
+        actuator_apply_step(act);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t actuator_init(void) {
+    if (s_lock) return ESP_OK;
+
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < ACTUATOR_COUNT; i++) {
+        actuator_t *act = &s_actuators[i];
+        const gpio_config_t io_conf = {
+            .pin_bit_mask = 1ULL << act->gpio,
+            .mode = GPIO_MODE_OUTPUT,
+            .pull_up_en = GPIO_PULLUP_DISABLE,
+            .pull_down_en = GPIO_PULLDOWN_DISABLE,
+            .intr_type = GPIO_INTR_DISABLE,
+        };
+        ESP_ERROR_CHECK(gpio_config(&io_conf));
+        gpio_set_level(act->gpio, 0);
+
+        const esp_timer_create_args_t timer_args = {
+            .callback = actuator_step_expired,
+            .arg = act,
+            .name = "actuator",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &act->timer));
+    }
+    return ESP_OK;
+}
+
+esp_err_t actuator_play(actuator_id_t id, const actuator_step_t *steps, size_t num_steps,
+                        uint8_t repeat, uint64_t requested_us) {
+    if (id >= ACTUATOR_COUNT || !steps || num_steps == 0 || num_steps > ACTUATOR_MAX_STEPS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    actuator_t *act = &s_actuators[id];
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (act->running) {
+        esp_timer_stop(act->timer);
+        act->stats.preempted++;
+    }
+    memcpy(act->steps, steps, num_steps * sizeof(steps[0]));
+    act->num_steps = num_steps;
+    act->step = 0;
+    act->repeat_left = repeat;
+    actuator_apply_step(act);
+
+    uint32_t latency_us = (uint32_t)(agv_proto_now_us() - requested_us);
+    act->stats.commands++;
+    act->stats.last_latency_us = latency_us;
+    act->stats.total_latency_us += latency_us;
+    if (latency_us > act->stats.max_latency_us) act->stats.max_latency_us = latency_us;
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGD(TAG, "Actuator %d: %u steps x%u, latency %" PRIu32 " us", id,
+             (unsigned)num_steps, repeat + 1, latency_us);
+    return ESP_OK;
+}
+
+esp_err_t actuator_set(actuator_id_t id, uint8_t level, uint16_t hold_ms, uint64_t requested_us) {
+    const actuator_step_t steps[] = {
+        {.level = level, .duration_ms = hold_ms},
+        {.level = 0, .duration_ms = 0},
+    };
+    return actuator_play(id, steps, hold_ms ? 2 : 1, 0, requested_us);
+}
+
+void actuator_get_stats(actuator_id_t id, actuator_stats_t *stats) {
+    if (id >= ACTUATOR_COUNT || !stats) return;
+    if (!s_lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_actuators[id].stats;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ACTUATOR_MAX_STEPS 8
+
+typedef enum {
+    ACTUATOR_LED_GREEN = 0,
+    ACTUATOR_COUNT
+} actuator_id_t;
+
+// One output level held for duration_ms, 0 = hold until the next command
+typedef struct {
+    uint8_t level;
+    uint16_t duration_ms;
+} actuator_step_t;
+
+typedef struct {
+    uint32_t commands;          // Sequences started
+    uint32_t preempted;         // Sequences cut short by a newer command
+    uint32_t last_latency_us;   // Command receipt to first output transition
+    uint32_t max_latency_us;
+    uint64_t total_latency_us;  // For the mean: total_latency_us / commands
+} actuator_stats_t;
+
+/**
+ * @brief Configure the actuator outputs (all off) and their step timers
+ */
+esp_err_t actuator_init(void);
+
+/**
+ * @brief Start a step sequence on an actuator without blocking
+ *
+ * Replaces whatever the actuator was doing. The first step is applied before
+ * returning; later steps are applied from an esp_timer callback. After the
+ * last step the sequence restarts repeat more times, then the output keeps
+ * the last step's level.
+ *
+ * @param id           Actuator
+ * @param steps        Up to ACTUATOR_MAX_STEPS steps, copied
+ * @param num_steps    Number of steps
+ * @param repeat       Extra passes over the sequence
+ * @param requested_us agv_proto_now_us() when the command was received, for latency stats
+ * @return ESP_OK, ESP_ERR_INVALID_ARG or ESP_ERR_INVALID_STATE if not initialized
+ */
+esp_err_t actuator_play(actuator_id_t id, const actuator_step_t *steps, size_t num_steps,
+                        uint8_t repeat, uint64_t requested_us);
+
+/**
+ * @brief Set a level, then return to 0 after hold_ms (0 = keep the level)
+ */
+esp_err_t actuator_set(actuator_id_t id, uint8_t level, uint16_t hold_ms, uint64_t requested_us);
+
+/**
+ * @brief Read the counters of one actuator
+ */
+void actuator_get_stats(actuator_id_t id, actuator_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
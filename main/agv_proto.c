@@ -0,0 +1,148 @@
+// agv_proto.c
+#include <string.h>
+#include "sdkconfig.h"
+#include "agv_proto.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_timer.h"
+#endif
+
+static uint16_t s_agv_id;
+static uint32_t s_boot_id;
+static uint32_t s_seq;
+
+// Fixed payload size per message type, 0 = unknown type
+static const uint8_t msg_payload_len[AGV_MSG_TYPE_MAX] = {
+    [AGV_MSG_HELLO]   = 0,
+    [AGV_MSG_TAG]     = sizeof(agv_msg_tag_t),
+    [AGV_MSG_SENSOR]  = sizeof(agv_msg_sensor_t),
+    [AGV_MSG_COMMAND] = sizeof(agv_msg_command_t),
+    [AGV_MSG_ZONE]    = sizeof(agv_msg_zone_t),
+    [AGV_MSG_ACK]     = sizeof(agv_msg_ack_t),
+    [AGV_MSG_BOOT]    = sizeof(agv_msg_boot_t),
+    [AGV_MSG_LOG]     = sizeof(agv_msg_log_t),
+    [AGV_MSG_METRICS] = sizeof(agv_msg_metrics_t),
+    [AGV_MSG_HISTOGRAM] = sizeof(agv_msg_histogram_t),
+    [AGV_MSG_TIME_REQ] = sizeof(agv_msg_time_req_t),
+    [AGV_MSG_TIME_RESP] = sizeof(agv_msg_time_resp_t),
+    [AGV_MSG_PROFILE] = sizeof(agv_msg_profile_t),
+    [AGV_MSG_TASK]    = sizeof(agv_msg_task_t),
+};
+
+static inline bool msg_type_valid(uint8_t type) {
+    return type == AGV_MSG_HELLO || (type < AGV_MSG_TYPE_MAX && msg_payload_len[type] != 0);
+}
+
+void agv_proto_init(uint16_t agv_id, uint32_t boot_id) {
+    s_agv_id = agv_id;
+    s_boot_id = boot_id;
+}
+
+uint64_t agv_proto_now_us(void) {
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+#else
+    return (uint64_t)esp_timer_get_time();
+#endif
+}
+
+void agv_proto_dgram_init(agv_proto_dgram_t *dgram) {
+    const agv_proto_dgram_hdr_t hdr = {
+        .magic = AGV_PROTO_MAGIC,
+        .version = AGV_PROTO_VERSION,
+        .agv_id = s_agv_id,
+        .boot_id = s_boot_id,
+    };
+    memcpy(dgram->buf, &hdr, sizeof(hdr));
+    dgram->len = sizeof(hdr);
+    dgram->count = 0;
+}
+
+uint32_t agv_proto_next_seq(void) {
+    // Producers run in several tasks, the sequence must stay unique
+    return __atomic_fetch_add(&s_seq, 1, __ATOMIC_RELAXED);
+}
+
+bool agv_proto_msg_valid(agv_msg_type_t type, size_t len) {
+    return msg_type_valid(type) && len == msg_payload_len[type];
+}
+
+static bool dgram_fits(const agv_proto_dgram_t *dgram, agv_msg_type_t type, size_t len) {
+    return agv_proto_msg_valid(type, len) &&
+           dgram->len + sizeof(agv_proto_msg_hdr_t) + len <= sizeof(dgram->buf);
+}
+
+bool agv_proto_dgram_append(agv_proto_dgram_t *dgram, agv_msg_type_t type, uint64_t timestamp_us,
+                            const void *payload, size_t len) {
+    // Checked first so a message that does not fit does not use up a seq
+    if (!dgram_fits(dgram, type, len)) return false;
+    return agv_proto_dgram_append_seq(dgram, type, agv_proto_next_seq(), timestamp_us, payload, len);
+}
+
+bool agv_proto_dgram_append_seq(agv_proto_dgram_t *dgram, agv_msg_type_t type, uint32_t seq,
+                                uint64_t timestamp_us, const void *payload, size_t len) {
+    if (!dgram_fits(dgram, type, len)) return false;
+
+    const agv_proto_msg_hdr_t hdr = {
+        .type = type,
+        .len = (uint8_t)len,
+        .seq = seq,
+        .timestamp_us = timestamp_us,
+    };
+    memcpy(&dgram->buf[dgram->len], &hdr, sizeof(hdr));
+    dgram->len += sizeof(hdr);
+    if (len) memcpy(&dgram->buf[dgram->len], payload, len);
+    dgram->len += len;
+    dgram->count++;
+    return true;
+}
+
+bool agv_proto_make_tag(agv_msg_tag_t *msg, const char *tag, size_t len) {
+    // A truncated tag would dedup and be acknowledged as a different tag
+    if (len > AGV_PROTO_TAG_MAX) return false;
+    memset(msg, 0, sizeof(*msg));
+    msg->len = (uint8_t)len;
+    memcpy(msg->tag, tag, len);
+    return true;
+}
+
+static bool dgram_hdr_read(const uint8_t *buf, size_t len, agv_proto_dgram_hdr_t *hdr) {
+    if (len < sizeof(*hdr)) return false;
+    memcpy(hdr, buf, sizeof(*hdr));
+    return hdr->magic == AGV_PROTO_MAGIC && hdr->version == AGV_PROTO_VERSION;
+}
+
+bool agv_proto_stamp_tx(uint8_t *buf, size_t len, uint64_t tx_us) {
+    agv_proto_dgram_hdr_t hdr;
+    if (!dgram_hdr_read(buf, len, &hdr)) return false;
+    memcpy(buf + offsetof(agv_proto_dgram_hdr_t, tx_us), &tx_us, sizeof(tx_us));
+    return true;
+}
+
+uint64_t agv_proto_dgram_tx_us(const uint8_t *buf, size_t len) {
+    agv_proto_dgram_hdr_t hdr;
+    return dgram_hdr_read(buf, len, &hdr) ? hdr.tx_us : 0;
+}
+
+int agv_proto_parse(const uint8_t *buf, size_t len, agv_proto_msg_cb_t cb, void *arg) {
+    agv_proto_dgram_hdr_t dgram_hdr;
+    if (!dgram_hdr_read(buf, len, &dgram_hdr)) return -1;
+
+    int count = 0;
+    size_t offset = sizeof(dgram_hdr);
+    while (offset + sizeof(agv_proto_msg_hdr_t) <= len) {
+        agv_proto_msg_hdr_t hdr;
+        memcpy(&hdr, &buf[offset], sizeof(hdr));
+        offset += sizeof(hdr);
+        // A wrong length means the rest of the datagram cannot be framed
+        if (!msg_type_valid(hdr.type) || hdr.len != msg_payload_len[hdr.type] || offset + hdr.len > len) break;
+        if (cb) cb(&hdr, &buf[offset], arg);
+        offset += hdr.len;
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,290 @@
+#ifndef AGV_PROTO_H
+#define AGV_PROTO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * AGV <-> fleet server UDP protocol, version 3. All fields little-endian.
+ *
+ * datagram := agv_proto_dgram_hdr_t { agv_proto_msg_hdr_t payload }*
+ *
+ * Every message type has a fixed payload size, so a datagram can carry as many
+ * messages as fit in the MTU and parsing is a constant-cost table check per message.
+ * The server answers every TAG with an ACK for its seq; until then the AGV
+ * retransmits it with the same seq and timestamp, so the server drops repeats by seq.
+ * Seqs start over on every boot, so the server keeps them per boot_id, which the AGV
+ * picks at random at startup and writes in every datagram header.
+ * Each side stamps tx_us into the datagram header as it hands it to sendto(); an ACK
+ * echoes the stamp of the datagram it answers and the server's receive time, so the
+ * AGV can split a tag's delivery time into queueing, Wi-Fi and server time.
+ * TIME_REQ/TIME_RESP use the same stamps for a two-way exchange that syncs the AGV
+ * to the server's clock; once synced, message timestamps are fleet time.
+ * Keep in sync with udp.py.
+ */
+
+#define AGV_PROTO_MAGIC     0xA6
+#define AGV_PROTO_VERSION   3
+#define AGV_PROTO_MAX_DGRAM 1400    // Stay below the Wi-Fi MTU, no IP fragmentation
+#define AGV_PROTO_TAG_MAX   24
+#define AGV_BOOT_MAX_STAGES 12
+#define AGV_LOG_MAX_ARGS    4
+#define AGV_LOG_STR_MAX     24      // Fits a whole tag
+#define AGV_METRICS_MAX_COUNTERS 32
+#define AGV_HIST_BUCKETS    20      // 0 us, then [2^(i-1), 2^i) us, the last is open ended
+#define AGV_PROTO_FLEET_TIME_MIN_US 1000000000000000ULL    // 2001-09-09: smaller timestamps are AGV uptime
+#define AGV_TASK_NAME_MAX   16      // configMAX_TASK_NAME_LEN
+#define AGV_TASK_CORE_ANY   0xFF
+#define AGV_TASK_CPU_UNKNOWN 0xFFFF // Built without FreeRTOS run time stats
+
+typedef enum {
+    AGV_MSG_HELLO   = 0x01,     // AGV -> server, sent once at startup
+    AGV_MSG_TAG     = 0x02,     // AGV -> server, RFID tag read
+    AGV_MSG_SENSOR  = 0x03,     // AGV -> server, proximity sensor sample/trigger
+    AGV_MSG_COMMAND = 0x04,     // server -> AGV, actuator command
+    AGV_MSG_ZONE    = 0x05,     // AGV -> server, proximity zone state change
+    AGV_MSG_ACK     = 0x06,     // server -> AGV, acknowledges TAG messages by seq
+    AGV_MSG_BOOT    = 0x07,     // AGV -> server, startup stage timings, once per boot
+    AGV_MSG_LOG     = 0x08,     // AGV -> server, deferred log record, formatted by the receiver
+    AGV_MSG_METRICS = 0x09,     // AGV -> server, counters, periodic
+    AGV_MSG_HISTOGRAM = 0x0A,   // AGV -> server, one latency histogram, sent with METRICS
+    AGV_MSG_TIME_REQ = 0x0B,    // AGV -> server, clock sync request, answered at once
+    AGV_MSG_TIME_RESP = 0x0C,   // server -> AGV, clock sync response
+    AGV_MSG_PROFILE = 0x0D,     // AGV -> server, heap and queue use, periodic, followed by its TASKs
+    AGV_MSG_TASK    = 0x0E,     // AGV -> server, one task's CPU share and stack use, sent with PROFILE
+    AGV_MSG_TYPE_MAX
+} agv_msg_type_t;
+
+typedef enum {
+    AGV_CMD_LED_GREEN_ON = 0x01,    // Green LED on for duration_ms, 0 = until LED_GREEN_OFF
+    AGV_CMD_LED_GREEN_OFF = 0x02,   // Green LED off, cancels any pattern
+    AGV_CMD_LED_GREEN_BLINK = 0x03, // Blink arg times, duration_ms on then duration_ms off
+} agv_cmd_t;
+
+typedef struct {
+    uint8_t magic;
+    uint8_t version;
+    uint16_t agv_id;
+    uint32_t boot_id;           // Random, new on every boot of the sender
+    uint64_t tx_us;             // Sender monotonic time at sendto(), 0 = not stamped
+} __attribute__((packed)) agv_proto_dgram_hdr_t;
+
+typedef struct {
+    uint8_t type;               // agv_msg_type_t
+    uint8_t len;                // Payload length, must match the type
+    uint32_t seq;               // Per-AGV sequence number
+    uint64_t timestamp_us;      // Event time: fleet time in us since the Unix epoch once the AGV
+                                // is synced (>= AGV_PROTO_FLEET_TIME_MIN_US), its uptime before
+} __attribute__((packed)) agv_proto_msg_hdr_t;
+
+// The header timestamp is when the tag was posted, tx_us of its datagram when it left
+typedef struct {
+    uint8_t len;
+    char tag[AGV_PROTO_TAG_MAX];    // Not null-terminated, zero padded
+    uint32_t usb_us;            // Report with the first character to the report with Enter, both USB completions
+    uint32_t decode_us;         // USB completion of the Enter report to the tag posted
+} __attribute__((packed)) agv_msg_tag_t;
+
+typedef struct {
+    uint8_t sensor_id;
+    uint8_t triggered;
+    uint16_t distance;          // Millimetres, UINT16_MAX = nothing in range
+} __attribute__((packed)) agv_msg_sensor_t;
+
+typedef struct {
+    uint8_t zone;               // proxy_zone_id_t: front, rear, left, right
+    uint8_t state;              // proxy_zone_state_t: clear, slow, stop
+    uint8_t prev_state;
+    uint8_t sensor_id;          // Sensor that caused the change
+    uint16_t distance;          // Its filtered distance in millimetres
+} __attribute__((packed)) agv_msg_zone_t;
+
+typedef struct {
+    uint8_t command;            // agv_cmd_t
+    uint8_t arg;                // Command specific, 0 if unused
+    uint16_t duration_ms;
+} __attribute__((packed)) agv_msg_command_t;
+
+// Bit i acknowledges seq base_seq + i, so one ACK covers any 32 consecutive seqs.
+// rx_us and the ACK datagram's tx_us are server time, only their difference is used.
+typedef struct {
+    uint32_t base_seq;
+    uint32_t mask;
+    uint64_t echo_tx_us;        // tx_us of the datagram being acknowledged, AGV time, 0 = unknown
+    uint64_t rx_us;             // When the server received that datagram, server time
+} __attribute__((packed)) agv_msg_ack_t;
+
+typedef struct {
+    uint32_t begin_us;          // Microseconds since startup, 0 = not started
+    uint32_t end_us;            // 0 = still running when the trace was sent
+} __attribute__((packed)) agv_boot_span_t;
+
+// Spans are indexed by boot_stage_t, see boot_trace.h
+typedef struct {
+    uint8_t count;              // Stages filled in
+    uint8_t reset_reason;       // esp_reset_reason_t
+    uint16_t reserved;
+    agv_boot_span_t spans[AGV_BOOT_MAX_STAGES];
+} __attribute__((packed)) agv_msg_boot_t;
+
+// The format string is not sent: fmt_id indexes main/dlog_formats.h, decoded by dlog_decode.py
+typedef struct {
+    uint16_t fmt_id;
+    uint8_t nargs;
+    uint8_t str_len;
+    uint32_t args[AGV_LOG_MAX_ARGS];
+    char str[AGV_LOG_STR_MAX];  // Argument of the %s or %H conversion, not null-terminated
+} __attribute__((packed)) agv_msg_log_t;
+
+// Totals since boot, indexed by the counter order in main/metrics_defs.h
+typedef struct {
+    uint32_t uptime_ms;
+    uint8_t count;              // Counters filled in
+    uint8_t reserved[3];
+    uint32_t counters[AGV_METRICS_MAX_COUNTERS];
+} __attribute__((packed)) agv_msg_metrics_t;
+
+typedef struct {
+    uint8_t id;                 // Histogram order in main/metrics_defs.h
+    uint8_t reserved[3];
+    uint32_t max_us;
+    uint32_t buckets[AGV_HIST_BUCKETS];     // Totals since boot
+} __attribute__((packed)) agv_msg_histogram_t;
+
+typedef struct {
+    uint32_t id;                // Request counter, for the server's log
+} __attribute__((packed)) agv_msg_time_req_t;
+
+// The response datagram's tx_us is the server's transmit time
+typedef struct {
+    uint32_t id;                // Of the request answered
+    uint32_t reserved;
+    uint64_t echo_tx_us;        // tx_us of the request datagram, AGV time
+    uint64_t rx_us;             // When the server received it, fleet time
+} __attribute__((packed)) agv_msg_time_resp_t;
+
+// Heap figures are internal RAM, where every task stack lives
+typedef struct {
+    uint32_t period_us;         // Run time the TASK CPU shares are taken over
+    uint32_t heap_free;
+    uint32_t heap_min_free;     // Low-water mark since boot
+    uint32_t heap_largest;      // Largest free block, far below heap_free means fragmentation
+    uint8_t task_count;         // TASK messages sent with this one
+    uint8_t queue_len;          // Capacity of the application event queue, 0 = not watched
+    uint8_t queue_waiting;      // Events in it at the report
+    uint8_t queue_max;          // Most seen at any sample over the period
+} __attribute__((packed)) agv_msg_profile_t;
+
+typedef struct {
+    char name[AGV_TASK_NAME_MAX];   // Null-terminated unless it fills the field
+    uint8_t core;               // Pinned core, AGV_TASK_CORE_ANY if it runs on either
+    uint8_t priority;           // Current, raised while it holds a mutex someone waits on
+    uint8_t state;              // eTaskState
+    uint8_t reserved;
+    uint16_t cpu_permille;      // Of one core over the period, so the two IDLE tasks add up to 2000 at rest
+    uint16_t stack_free_min;    // Bytes of stack never touched since the task started
+} __attribute__((packed)) agv_msg_task_t;
+
+// Datagram being built
+typedef struct {
+    uint8_t buf[AGV_PROTO_MAX_DGRAM];
+    size_t len;
+    uint16_t count;             // Messages in buf
+} agv_proto_dgram_t;
+
+/**
+ * @brief Called by agv_proto_parse() for every valid message
+ *
+ * @param hdr     Message header
+ * @param payload Payload of hdr->len bytes, possibly unaligned, valid only during the call
+ * @param arg     User argument
+ */
+typedef void (*agv_proto_msg_cb_t)(const agv_proto_msg_hdr_t *hdr, const void *payload, void *arg);
+
+/**
+ * @brief Set the AGV and boot ids written in every datagram header
+ *
+ * @param agv_id  This AGV
+ * @param boot_id Random per boot, e.g. esp_random(), so the server can tell a restart from a retransmission
+ */
+void agv_proto_init(uint16_t agv_id, uint32_t boot_id);
+
+/**
+ * @brief Monotonic time in microseconds used for message timestamps
+ */
+uint64_t agv_proto_now_us(void);
+
+/**
+ * @brief Start an empty datagram
+ */
+void agv_proto_dgram_init(agv_proto_dgram_t *dgram);
+
+/**
+ * @brief Reserve the next sequence number, for messages that may be sent more than once
+ */
+uint32_t agv_proto_next_seq(void);
+
+/**
+ * @brief Check that type is known and len is the payload size defined for it
+ */
+bool agv_proto_msg_valid(agv_msg_type_t type, size_t len);
+
+/**
+ * @brief Append one message, assigning the next sequence number
+ *
+ * @param dgram        Datagram being built
+ * @param type         Message type
+ * @param timestamp_us Event time from agv_proto_now_us()
+ * @param payload      Payload of exactly the size defined for type
+ * @param len          Payload length
+ * @return true if the message was appended, false if it does not fit or len is wrong
+ */
+bool agv_proto_dgram_append(agv_proto_dgram_t *dgram, agv_msg_type_t type, uint64_t timestamp_us,
+                            const void *payload, size_t len);
+
+/**
+ * @brief Append one message with a sequence number from agv_proto_next_seq()
+ *
+ * Same as agv_proto_dgram_append(), used to retransmit a message unchanged.
+ */
+bool agv_proto_dgram_append_seq(agv_proto_dgram_t *dgram, agv_msg_type_t type, uint32_t seq,
+                                uint64_t timestamp_us, const void *payload, size_t len);
+
+/**
+ * @brief Fill a tag payload
+ *
+ * @return false, msg untouched, if the tag is longer than AGV_PROTO_TAG_MAX
+ */
+bool agv_proto_make_tag(agv_msg_tag_t *msg, const char *tag, size_t len);
+
+/**
+ * @brief Write the transmit time into a built datagram, called by the transport just before sendto()
+ *
+ * @return false if buf does not start with a datagram header
+ */
+bool agv_proto_stamp_tx(uint8_t *buf, size_t len, uint64_t tx_us);
+
+/**
+ * @brief Read the sender's transmit time of a received datagram
+ *
+ * @return tx_us from the header, 0 if not stamped or the header is invalid
+ */
+uint64_t agv_proto_dgram_tx_us(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Validate a received datagram and call cb for every message in it
+ *
+ * @return Number of messages delivered, or -1 if the datagram header is invalid
+ */
+int agv_proto_parse(const uint8_t *buf, size_t len, agv_proto_msg_cb_t cb, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AGV_PROTO_H
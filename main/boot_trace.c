@@ -0,0 +1,127 @@
+// boot_trace.c
+#include <string.h>
+#include <inttypes.h>
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "boot_trace.h"
+
+static const char *TAG = "boot_trace";
+
+static const char *stage_names[BOOT_STAGE_COUNT] = {
+    [BOOT_STAGE_NVS] = "nvs",
+    [BOOT_STAGE_WIFI_INIT] = "wifi_init",
+    [BOOT_STAGE_WIFI_CONNECT] = "wifi_connect",
+    [BOOT_STAGE_UPLINK] = "uplink",
+    [BOOT_STAGE_USB_HOST] = "usb_host",
+    [BOOT_STAGE_HID] = "hid",
+    [BOOT_STAGE_SENSORS] = "sensors",
+    [BOOT_STAGE_HID_ENUM] = "hid_enum",
+    [BOOT_STAGE_HID_REPORT_DESC] = "hid_report_desc",
+};
+
+// Stages the trace waits for
+#define BOOT_TRACE_REQUIRED ((1u << BOOT_STAGE_COUNT) - 1 - (1u << BOOT_STAGE_HID_REPORT_DESC))
+
+// Stages end in different tasks; each field is written once, by compare-and-swap from 0
+static boot_stage_span_t spans[BOOT_STAGE_COUNT];
+static uint32_t ended_mask;
+static bool done;
+static esp_timer_handle_t deadline_timer;
+static boot_trace_done_cb_t done_cb;
+static void *done_cb_arg;
+
+static void boot_trace_done(void) {
+    if (__atomic_exchange_n(&done, true, __ATOMIC_ACQ_REL)) return;
+    if (done_cb) done_cb(done_cb_arg);
+}
+
+static void boot_trace_deadline(void *arg) {
+    ESP_LOGW(TAG, "Deadline reached with stages still running");
+    boot_trace_done();
+}
+
+esp_err_t boot_trace_init(uint32_t deadline_us, boot_trace_done_cb_t cb, void *arg) {
+    done_cb = cb;
+    done_cb_arg = arg;
+    if (deadline_timer) return ESP_OK;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = boot_trace_deadline,
+        .name = "boot_trace",
+    };
+    if (esp_timer_create(&timer_args, &deadline_timer) != ESP_OK) return ESP_ERR_NO_MEM;
+    const int64_t now = esp_timer_get_time();
+    const int64_t deadline = deadline_us ? deadline_us : BOOT_TRACE_DEFAULT_DEADLINE_US;
+    esp_timer_start_once(deadline_timer, deadline > now ? deadline - now : 1);
+    return ESP_OK;
+}
+
+static void boot_trace_ended(boot_stage_t stage) {
+    const uint32_t ended = __atomic_or_fetch(&ended_mask, 1u << stage, __ATOMIC_ACQ_REL);
+    if ((ended & BOOT_TRACE_REQUIRED) != BOOT_TRACE_REQUIRED) return;
+    if (deadline_timer) esp_timer_stop(deadline_timer);
+    boot_trace_done();
+}
+
+void boot_trace_begin(boot_stage_t stage) {
+    if (stage >= BOOT_STAGE_COUNT) return;
+    int64_t unset = 0;
+    __atomic_compare_exchange_n(&spans[stage].begin_us, &unset, esp_timer_get_time(), false,
+                                __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+void boot_trace_end(boot_stage_t stage) {
+    if (stage >= BOOT_STAGE_COUNT || !__atomic_load_n(&spans[stage].begin_us, __ATOMIC_ACQUIRE)) return;
+    int64_t unset = 0;
+    if (__atomic_compare_exchange_n(&spans[stage].end_us, &unset, esp_timer_get_time(), false,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        boot_trace_ended(stage);
+    }
+}
+
+void boot_trace_span(boot_stage_t stage, int64_t begin_us, int64_t end_us) {
+    if (stage >= BOOT_STAGE_COUNT || !begin_us || end_us < begin_us) return;
+    int64_t unset = 0;
+    if (!__atomic_compare_exchange_n(&spans[stage].begin_us, &unset, begin_us, false,
+                                     __ATOMIC_RELEASE, __ATOMIC_RELAXED)) return;
+    __atomic_store_n(&spans[stage].end_us, end_us, __ATOMIC_RELEASE);
+    boot_trace_ended(stage);
+}
+
+bool boot_trace_get(boot_stage_t stage, boot_stage_span_t *span) {
+    if (stage >= BOOT_STAGE_COUNT || !span) return false;
+    span->begin_us = __atomic_load_n(&spans[stage].begin_us, __ATOMIC_ACQUIRE);
+    span->end_us = __atomic_load_n(&spans[stage].end_us, __ATOMIC_ACQUIRE);
+    return span->end_us != 0;
+}
+
+void boot_trace_encode(agv_msg_boot_t *msg) {
+    memset(msg, 0, sizeof(*msg));
+    msg->count = BOOT_STAGE_COUNT;
+    msg->reset_reason = (uint8_t)esp_reset_reason();
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        boot_stage_span_t span;
+        boot_trace_get(i, &span);
+        msg->spans[i].begin_us = (uint32_t)span.begin_us;
+        msg->spans[i].end_us = (uint32_t)span.end_us;
+    }
+}
+
+void boot_trace_report(void) {
+    int64_t ready_us = 0;
+    ESP_LOGI(TAG, "%-16s %10s %10s", "stage", "start ms", "took ms");
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        boot_stage_span_t span;
+        const bool ended = boot_trace_get(i, &span);
+        if (!span.begin_us) continue;
+        if (!ended) {
+            ESP_LOGI(TAG, "%-16s %10.1f %10s", stage_names[i], span.begin_us / 1000.0, "running");
+            continue;
+        }
+        ESP_LOGI(TAG, "%-16s %10.1f %10.1f", stage_names[i], span.begin_us / 1000.0,
+                 (span.end_us - span.begin_us) / 1000.0);
+        if (span.end_us > ready_us) ready_us = span.end_us;
+    }
+    ESP_LOGI(TAG, "Ready %.1f ms after startup", ready_us / 1000.0);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "agv_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOOT_TRACE_DEFAULT_DEADLINE_US  20000000    // Report anyway if a stage never ends, e.g. no reader
+
+// Startup stages; they may overlap, e.g. Wi-Fi association runs while USB enumerates.
+// The order is the wire order of AGV_MSG_BOOT, append only and keep in sync with udp.py.
+typedef enum {
+    BOOT_STAGE_NVS = 0,
+    BOOT_STAGE_WIFI_INIT,       // Netif and driver, returns before association
+    BOOT_STAGE_WIFI_CONNECT,    // Wi-Fi init to the first IP address
+    BOOT_STAGE_UPLINK,          // Offline store, uplink, reliable delivery and the socket
+    BOOT_STAGE_USB_HOST,
+    BOOT_STAGE_HID,             // hid_host_install()
+    BOOT_STAGE_SENSORS,
+    BOOT_STAGE_HID_ENUM,        // First reader recognised as HID to its IN transfers started
+    BOOT_STAGE_HID_REPORT_DESC, // Report Descriptor request, optional: boot protocol readers skip it
+    BOOT_STAGE_COUNT,
+} boot_stage_t;
+
+_Static_assert(BOOT_STAGE_COUNT <= AGV_BOOT_MAX_STAGES, "AGV_MSG_BOOT has no room for every stage");
+
+typedef struct {
+    int64_t begin_us;           // esp_timer time, 0 = not started
+    int64_t end_us;             // 0 = still running
+} boot_stage_span_t;
+
+/**
+ * @brief Called once, when every required stage has ended or at the deadline
+ *
+ * Runs in the task that ended the last stage, or in the esp_timer task.
+ */
+typedef void (*boot_trace_done_cb_t)(void *arg);
+
+/**
+ * @brief Arm the deadline, call first thing in app_main
+ *
+ * @param deadline_us Time after startup to report what is there, 0 = default
+ * @param cb          Called once the trace is complete, may be NULL
+ * @param arg         User argument for cb
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the deadline timer could not be created
+ */
+esp_err_t boot_trace_init(uint32_t deadline_us, boot_trace_done_cb_t cb, void *arg);
+
+/**
+ * @brief Record the start of a stage, later calls for the same stage are ignored
+ */
+void boot_trace_begin(boot_stage_t stage);
+
+/**
+ * @brief Record the end of a stage, from any task; only the first end counts
+ */
+void boot_trace_end(boot_stage_t stage);
+
+/**
+ * @brief Record a stage timed elsewhere, e.g. by a driver; ignored if the stage already started
+ */
+void boot_trace_span(boot_stage_t stage, int64_t begin_us, int64_t end_us);
+
+/**
+ * @brief Copy the span of a stage
+ *
+ * @return false if the stage has not ended
+ */
+bool boot_trace_get(boot_stage_t stage, boot_stage_span_t *span);
+
+/**
+ * @brief Fill an AGV_MSG_BOOT payload with every stage
+ */
+void boot_trace_encode(agv_msg_boot_t *msg);
+
+/**
+ * @brief Log each stage's start and duration
+ */
+void boot_trace_report(void);
+
+#ifdef __cplusplus
+}
+#endif
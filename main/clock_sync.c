@@ -0,0 +1,204 @@
+// clock_sync.c
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "udp_uplink.h"
+#include "clock_sync.h"
+
+static const char *TAG = "clock_sync";
+
+#define CLOCK_SYNC_RETRY_US     1000    // Until a producer holding the uplink lets go
+
+// fleet(t) = t + ref_offset_us + (t - ref_local_us) * drift_ppb / 1e9
+typedef struct {
+    uint64_t ref_local_us;
+    int64_t ref_offset_us;
+    int32_t drift_ppb;
+} clock_model_t;
+
+typedef struct {
+    uint64_t local_us;          // Midpoint of the exchange, local time
+    int64_t offset_us;
+    uint32_t delay_us;
+} clock_sample_t;
+
+static clock_sync_config_t sync_config;
+static esp_timer_handle_t request_timer;
+static uint32_t request_id;
+static uint32_t fast_left;      // Exchanges still sent at the fast period
+static bool paused = true;      // Link down, see clock_sync_set_paused()
+
+// Seqlock: written by the transport task only, odd while an update is in progress.
+// The update runs in a critical section, so no reader on the writer's core, task or
+// ISR, can preempt it and spin on an odd count; the other core waits a few stores.
+static portMUX_TYPE model_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t model_seq;
+static clock_model_t model;
+static bool synced;
+
+// Transport task only
+static clock_sample_t samples[CLOCK_SYNC_SAMPLES];
+static uint32_t sample_count;
+static clock_sample_t applied;  // Sample the model was last set from
+static clock_sample_t anchor;   // Start of the span the next drift estimate is taken over
+static uint32_t floor_delay_us;
+
+static clock_sync_stats_t stats;
+
+static void model_store(const clock_model_t *next) {
+    taskENTER_CRITICAL(&model_lock);
+    __atomic_store_n(&model_seq, model_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    model = *next;
+    __atomic_store_n(&synced, true, __ATOMIC_RELAXED);
+    __atomic_store_n(&model_seq, model_seq + 1, __ATOMIC_RELEASE);
+    taskEXIT_CRITICAL(&model_lock);
+}
+
+static bool model_load(clock_model_t *out) {
+    uint32_t seq;
+    do {
+        seq = __atomic_load_n(&model_seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        *out = model;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&model_seq, __ATOMIC_RELAXED));
+    return __atomic_load_n(&synced, __ATOMIC_RELAXED);
+}
+
+uint64_t clock_sync_fleet_us(uint64_t local_us) {
+    clock_model_t m;
+    if (!model_load(&m)) return 0;
+    const int64_t since_ref = (int64_t)(local_us - m.ref_local_us);
+    return local_us + m.ref_offset_us + since_ref * m.drift_ppb / 1000000000LL;
+}
+
+// Runs in the esp_timer task; the request's datagram is stamped at sendto(), that is T1.
+// Never blocks there, a busy uplink is retried shortly without using up the period.
+static void clock_sync_request(void *arg) {
+    if (!__atomic_load_n(&paused, __ATOMIC_RELAXED)) {
+        const agv_msg_time_req_t req = {.id = request_id};
+        esp_err_t err = udp_uplink_try_post(AGV_MSG_TIME_REQ, &req, sizeof(req), UDP_UPLINK_PRIO_URGENT);
+        if (err == ESP_ERR_TIMEOUT) {
+            esp_timer_start_once(request_timer, CLOCK_SYNC_RETRY_US);
+            return;
+        }
+        request_id++;
+        if (err == ESP_OK) __atomic_fetch_add(&stats.requests, 1, __ATOMIC_RELAXED);
+    }
+    uint32_t period_ms = sync_config.period_ms;
+    if (fast_left) {
+        fast_left--;
+        period_ms = CLOCK_SYNC_FAST_PERIOD_MS;
+    }
+    esp_timer_start_once(request_timer, (uint64_t)period_ms * 1000);
+}
+
+// Rate error from two filtered offsets far enough apart, smoothed over successive spans
+static void clock_sync_update_drift(const clock_sample_t *best, int32_t *drift_ppb) {
+    // The floor may have dropped since the anchor was taken, then it was a queued exchange after all
+    if (!anchor.local_us || anchor.delay_us > floor_delay_us + CLOCK_SYNC_DELAY_MARGIN_US) {
+        anchor = *best;
+        return;
+    }
+    const int64_t span_us = (int64_t)(best->local_us - anchor.local_us);
+    if (span_us < CLOCK_SYNC_DRIFT_MIN_US) return;
+
+    int64_t measured = (best->offset_us - anchor.offset_us) * 1000000000LL / span_us;
+    if (measured > CLOCK_SYNC_MAX_DRIFT_PPB) measured = CLOCK_SYNC_MAX_DRIFT_PPB;
+    if (measured < -CLOCK_SYNC_MAX_DRIFT_PPB) measured = -CLOCK_SYNC_MAX_DRIFT_PPB;
+    *drift_ppb = *drift_ppb ? (int32_t)(*drift_ppb + (measured - *drift_ppb) / 4) : (int32_t)measured;
+    anchor = *best;
+}
+
+// Runs in the udp_service transport task
+void clock_sync_on_response(const agv_msg_time_resp_t *resp, uint64_t server_tx_us, uint64_t rx_us) {
+    const uint64_t t1 = resp->echo_tx_us, t2 = resp->rx_us, t3 = server_tx_us, t4 = rx_us;
+    __atomic_fetch_add(&stats.responses, 1, __ATOMIC_RELAXED);
+    if (!t1 || t4 < t1 || t3 < t2 || t4 - t1 < t3 - t2 || (t4 - t1) - (t3 - t2) > CLOCK_SYNC_MAX_DELAY_US) {
+        __atomic_fetch_add(&stats.rejected, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    const clock_sample_t sample = {
+        .local_us = t1 + (t4 - t1) / 2,
+        .offset_us = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2,
+        .delay_us = (uint32_t)((t4 - t1) - (t3 - t2)),
+    };
+    samples[sample_count++ % CLOCK_SYNC_SAMPLES] = sample;
+    stats.offset_us = sample.offset_us;
+    stats.delay_us = sample.delay_us;
+
+    // Queueing only ever adds delay, and it adds it asymmetrically: trust the fastest exchange
+    const clock_sample_t *best = &samples[0];
+    const uint32_t filled = sample_count < CLOCK_SYNC_SAMPLES ? sample_count : CLOCK_SYNC_SAMPLES;
+    for (uint32_t i = 1; i < filled; i++) {
+        if (samples[i].delay_us < best->delay_us) best = &samples[i];
+    }
+    // Down at once, up by an eighth per exchange: a roam to a slower path is followed in a minute or two
+    if (!floor_delay_us || best->delay_us < floor_delay_us) floor_delay_us = best->delay_us;
+    else floor_delay_us += (best->delay_us - floor_delay_us) / 8;
+    stats.floor_delay_us = floor_delay_us;
+
+    // The first exchange sets the clock whatever its round trip. It also sets the floor,
+    // so it is close to it and anchors the first drift span; a slow one is replaced as the
+    // floor drops, see clock_sync_update_drift()
+    const bool first = !__atomic_load_n(&synced, __ATOMIC_RELAXED);
+    const bool close_to_floor = best->delay_us <= floor_delay_us + CLOCK_SYNC_DELAY_MARGIN_US;
+    if (!first && !close_to_floor) {
+        __atomic_fetch_add(&stats.holdovers, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (!first && best->local_us == applied.local_us) return;
+
+    clock_model_t next = model;
+    if (close_to_floor) clock_sync_update_drift(best, &next.drift_ppb);
+    next.ref_local_us = best->local_us;
+    next.ref_offset_us = best->offset_us;
+    model_store(&next);
+    applied = *best;
+    stats.best_delay_us = best->delay_us;
+    stats.drift_ppb = next.drift_ppb;
+
+    if (first) {
+        ESP_LOGI(TAG, "Synced, offset %" PRId64 " us, round trip %" PRIu32 " us", best->offset_us, best->delay_us);
+    }
+}
+
+void clock_sync_set_paused(bool pause) {
+    const bool was_paused = __atomic_exchange_n(&paused, pause, __ATOMIC_RELAXED);
+    if (!request_timer || pause || !was_paused) return;
+    // Possibly a new AP and path: fill the window again quickly
+    fast_left = CLOCK_SYNC_SAMPLES;
+    esp_timer_stop(request_timer);
+    esp_timer_start_once(request_timer, 1);
+}
+
+esp_err_t clock_sync_init(const clock_sync_config_t *config) {
+    if (request_timer) return ESP_ERR_INVALID_STATE;
+    if (config) sync_config = *config;
+    if (sync_config.period_ms == 0) sync_config.period_ms = CLOCK_SYNC_DEFAULT_PERIOD_MS;
+    fast_left = CLOCK_SYNC_SAMPLES;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = clock_sync_request,
+        .name = "clock_sync",
+    };
+    if (esp_timer_create(&timer_args, &request_timer) != ESP_OK) return ESP_ERR_NO_MEM;
+    esp_timer_start_once(request_timer, 1);
+    ESP_LOGI(TAG, "Exchange every %" PRIu32 " ms, offset from the best of %d", sync_config.period_ms,
+             CLOCK_SYNC_SAMPLES);
+    return ESP_OK;
+}
+
+void clock_sync_get_stats(clock_sync_stats_t *out) {
+    if (!out) return;
+    *out = stats;
+    out->synced = __atomic_load_n(&synced, __ATOMIC_RELAXED);
+    out->requests = __atomic_load_n(&stats.requests, __ATOMIC_RELAXED);
+    out->responses = __atomic_load_n(&stats.responses, __ATOMIC_RELAXED);
+    out->rejected = __atomic_load_n(&stats.rejected, __ATOMIC_RELAXED);
+    out->holdovers = __atomic_load_n(&stats.holdovers, __ATOMIC_RELAXED);
+}
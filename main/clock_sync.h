@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "agv_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CLOCK_SYNC_SAMPLES              8           // Exchanges the offset is filtered over
+#define CLOCK_SYNC_FAST_PERIOD_MS       1000        // Until the window is full, after boot or a link change
+#define CLOCK_SYNC_DEFAULT_PERIOD_MS    10000
+#define CLOCK_SYNC_MAX_DELAY_US         200000      // Slower exchanges say nothing useful about the offset
+#define CLOCK_SYNC_DELAY_MARGIN_US      500         // Above the round trip floor: at most half of it is offset error
+#define CLOCK_SYNC_DRIFT_MIN_US         60000000    // Shortest span a drift estimate is taken over
+#define CLOCK_SYNC_MAX_DRIFT_PPB        500000      // Well beyond any crystal, larger estimates are noise
+
+typedef struct {
+    uint32_t period_ms;         // Between exchanges once the window is full, 0 = default
+} clock_sync_config_t;
+
+typedef struct {
+    bool synced;                // An offset is known, clock_sync_fleet_us() converts
+    uint32_t requests;
+    uint32_t responses;
+    uint32_t rejected;          // Inconsistent stamps or slower than CLOCK_SYNC_MAX_DELAY_US
+    uint32_t holdovers;         // Whole window queued behind other traffic, the clock ran on the rate estimate
+    int64_t offset_us;          // Fleet minus local time at the last accepted exchange
+    uint32_t delay_us;          // Its round trip without the server's hold time
+    uint32_t best_delay_us;     // Of the exchange the clock is set from, the lowest in the window
+    uint32_t floor_delay_us;    // Lowest round trip seen, aged up slowly to follow a path change
+    int32_t drift_ppb;          // Local clock rate error, positive when it runs slow
+} clock_sync_stats_t;
+
+/**
+ * @brief Start exchanging time with the server, udp_uplink_init() must have been called
+ *
+ * Two-way exchange over the uplink: the AGV sends AGV_MSG_TIME_REQ, whose datagram
+ * is stamped at sendto(); the server answers with AGV_MSG_TIME_RESP carrying that
+ * stamp, its receive time, and its own stamp on the reply. The offset is taken from
+ * the exchange with the lowest round trip of the last CLOCK_SYNC_SAMPLES, and only if
+ * that is within CLOCK_SYNC_DELAY_MARGIN_US of the round trip floor; the drift comes
+ * from successive such offsets at least CLOCK_SYNC_DRIFT_MIN_US apart.
+ *
+ * @param config NULL for the defaults
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if already started, or ESP_ERR_NO_MEM
+ */
+esp_err_t clock_sync_init(const clock_sync_config_t *config);
+
+/**
+ * @brief Handle a time response, called by the receive path
+ *
+ * @param resp         Response payload
+ * @param server_tx_us tx_us of the datagram that carried it, fleet time
+ * @param rx_us        agv_proto_now_us() when the datagram was received
+ */
+void clock_sync_on_response(const agv_msg_time_resp_t *resp, uint64_t server_tx_us, uint64_t rx_us);
+
+/**
+ * @brief Convert a monotonic agv_proto_now_us() time to fleet time
+ *
+ * Lock-free and safe from any task or ISR. Past times are converted with the current
+ * rate estimate, so an event keeps its fleet time however long it waited to be sent.
+ *
+ * @return Microseconds since the Unix epoch on the server's clock, 0 if not synced yet
+ */
+uint64_t clock_sync_fleet_us(uint64_t local_us);
+
+/**
+ * @brief Hold exchanges while the link is down, resume with fast ones after
+ *
+ * The clock keeps converting with the last estimate meanwhile. Starts paused.
+ */
+void clock_sync_set_paused(bool paused);
+
+/**
+ * @brief Read the sync state
+ */
+void clock_sync_get_stats(clock_sync_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
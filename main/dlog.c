@@ -0,0 +1,211 @@
+// dlog.c
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "udp_uplink.h"
+#include "dlog.h"
+
+#define DLOG_SLOT_MASK (DLOG_RING_SLOTS - 1)
+
+_Static_assert((DLOG_RING_SLOTS & DLOG_SLOT_MASK) == 0, "DLOG_RING_SLOTS must be a power of two");
+
+#if portNUM_PROCESSORS > 1
+#define DLOG_CORES          portNUM_PROCESSORS
+#define DLOG_CORE_ID()      xPortGetCoreID()
+#else
+#define DLOG_CORES          1
+#define DLOG_CORE_ID()      0
+#endif
+
+typedef struct {
+    esp_log_level_t level;
+    const char *tag;
+    const char *format;
+} dlog_format_t;
+
+static const dlog_format_t dlog_formats[DLOG_FMT_COUNT] = {
+#define DLOG_FMT(id, level, tag, format) [id] = {level, tag, format},
+#include "dlog_formats.h"
+#undef DLOG_FMT
+};
+
+// Bounded MPSC ring, as in udp_service.c, but zero-initialised so records can be written
+// before dlog_init(): a slot is free while seq == the lap of its position, published at lap + 1
+typedef struct {
+    uint32_t seq;
+    dlog_entry_t entry;
+} dlog_slot_t;
+
+typedef struct {
+    dlog_slot_t slots[DLOG_RING_SLOTS];
+    uint32_t head;              // Next position to claim, shared by the tasks on this core
+    uint32_t tail;              // Next position to read, formatter only
+} dlog_ring_t;
+
+static dlog_ring_t rings[DLOG_CORES];
+static esp_log_level_t write_level = CONFIG_LOG_DEFAULT_LEVEL;
+static dlog_config_t dlog_config = {.udp_level = ESP_LOG_NONE};
+static TaskHandle_t dlog_task_handle;
+static dlog_stats_t stats;
+
+void dlog_write(dlog_fmt_t fmt, const void *str, size_t len, const uint32_t *args, size_t n) {
+    if (fmt >= DLOG_FMT_COUNT || dlog_formats[fmt].level > write_level) return;
+
+    dlog_ring_t *ring = &rings[DLOG_CORE_ID()];
+    uint32_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    dlog_slot_t *slot;
+    for (;;) {
+        slot = &ring->slots[pos & DLOG_SLOT_MASK];
+        int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (pos & ~DLOG_SLOT_MASK));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    dlog_entry_t *entry = &slot->entry;
+    entry->timestamp_us = agv_proto_now_us();
+    entry->msg.fmt_id = fmt;
+    entry->msg.nargs = n < AGV_LOG_MAX_ARGS ? n : AGV_LOG_MAX_ARGS;
+    memcpy(entry->msg.args, args, entry->msg.nargs * sizeof(uint32_t));
+    entry->msg.str_len = str ? (len < AGV_LOG_STR_MAX ? len : AGV_LOG_STR_MAX) : 0;
+    if (str) memcpy(entry->msg.str, str, entry->msg.str_len);
+    __atomic_store_n(&slot->seq, (pos & ~DLOG_SLOT_MASK) + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&stats.written, 1, __ATOMIC_RELAXED);
+}
+
+bool dlog_read(dlog_entry_t *entry) {
+    // Oldest of the ring heads, so lines from both cores come out in time order
+    dlog_slot_t *oldest = NULL;
+    dlog_ring_t *oldest_ring = NULL;
+    for (int i = 0; i < DLOG_CORES; i++) {
+        dlog_ring_t *ring = &rings[i];
+        dlog_slot_t *slot = &ring->slots[ring->tail & DLOG_SLOT_MASK];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != (ring->tail & ~DLOG_SLOT_MASK) + 1) continue;
+        if (!oldest || slot->entry.timestamp_us < oldest->entry.timestamp_us) {
+            oldest = slot;
+            oldest_ring = ring;
+        }
+    }
+    if (!oldest) return false;
+
+    *entry = oldest->entry;
+    __atomic_store_n(&oldest->seq, (oldest_ring->tail & ~DLOG_SLOT_MASK) + DLOG_RING_SLOTS, __ATOMIC_RELEASE);
+    oldest_ring->tail++;
+    return true;
+}
+
+int dlog_format(const agv_msg_log_t *msg, char *buf, size_t size) {
+    if (size == 0) return 0;
+    if (msg->fmt_id >= DLOG_FMT_COUNT) return snprintf(buf, size, "<unknown log format %u>", msg->fmt_id);
+
+    const char *f = dlog_formats[msg->fmt_id].format;
+    size_t out = 0;
+    int arg = 0;
+    while (*f && out + 1 < size) {
+        if (*f != '%') {
+            buf[out++] = *f++;
+            continue;
+        }
+        if (f[1] == '%') {
+            buf[out++] = '%';
+            f += 2;
+            continue;
+        }
+
+        char spec[16];
+        size_t n = 0;
+        spec[n++] = *f++;
+        while (*f && strchr("-+ #0123456789.", *f) && n < sizeof(spec) - 2) spec[n++] = *f++;
+        const char conv = *f ? *f++ : '\0';
+        spec[n++] = conv;
+        spec[n] = '\0';
+
+        const uint32_t value = arg < msg->nargs ? msg->args[arg] : 0;
+        int written = 0;
+        switch (conv) {
+        case 's':
+            written = snprintf(buf + out, size - out, "%.*s", msg->str_len, msg->str);
+            break;
+        case 'H':
+            for (int i = 0; i < msg->str_len && out + written + 2 < size; i++) {
+                written += snprintf(buf + out + written, size - out - written, "%02X", (uint8_t)msg->str[i]);
+            }
+            break;
+        case 'd': case 'i': case 'c':
+            written = snprintf(buf + out, size - out, spec, (int)value);
+            arg++;
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            written = snprintf(buf + out, size - out, spec, (unsigned int)value);
+            arg++;
+            break;
+        default:
+            written = snprintf(buf + out, size - out, "%s", spec);
+            break;
+        }
+        if (written < 0) break;
+        out += (size_t)written < size - out ? (size_t)written : size - out - 1;
+    }
+    buf[out] = '\0';
+    return (int)out;
+}
+
+static void dlog_emit(const dlog_entry_t *entry) {
+    static char line[DLOG_LINE_MAX];    // Formatter only
+    static const char letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+    const dlog_format_t *format = &dlog_formats[entry->msg.fmt_id < DLOG_FMT_COUNT ? entry->msg.fmt_id : 0];
+
+    dlog_format(&entry->msg, line, sizeof(line));
+    // Same layout as ESP_LOGx, with the time the record was written
+    esp_log_write(format->level, format->tag, "%c (%" PRIu32 ") %s: %s\n", letters[format->level],
+                  (uint32_t)(entry->timestamp_us / 1000), format->tag, line);
+    if (dlog_config.udp_level != ESP_LOG_NONE && format->level <= dlog_config.udp_level) {
+        udp_uplink_post_seq(AGV_MSG_LOG, agv_proto_next_seq(), udp_uplink_event_us(entry->timestamp_us),
+                            &entry->msg, sizeof(entry->msg), UDP_UPLINK_PRIO_NORMAL);
+    }
+    __atomic_fetch_add(&stats.emitted, 1, __ATOMIC_RELAXED);
+}
+
+void dlog_flush(void) {
+    dlog_entry_t entry;
+    while (dlog_read(&entry)) dlog_emit(&entry);
+}
+
+static void dlog_task(void *arg) {
+    for (;;) {
+        dlog_flush();
+        vTaskDelay(pdMS_TO_TICKS(DLOG_TASK_PERIOD_MS));
+    }
+}
+
+esp_err_t dlog_init(const dlog_config_t *config) {
+    if (dlog_task_handle) return ESP_ERR_INVALID_STATE;
+    if (config) dlog_config = *config;
+    if (xTaskCreate(dlog_task, "dlog", DLOG_TASK_STACK, NULL, DLOG_TASK_PRIORITY, &dlog_task_handle) != pdPASS) {
+        dlog_task_handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void dlog_set_level(esp_log_level_t level) {
+    write_level = level;
+}
+
+void dlog_get_stats(dlog_stats_t *out) {
+    if (!out) return;
+    out->written = __atomic_load_n(&stats.written, __ATOMIC_RELAXED);
+    out->dropped = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+    out->emitted = __atomic_load_n(&stats.emitted, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "agv_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DLOG_RING_SLOTS     128     // Records per core, power of two
+#define DLOG_LINE_MAX       160     // Longest formatted line
+#define DLOG_TASK_STACK     3072
+#define DLOG_TASK_PRIORITY  1       // Below everything that produces records
+#define DLOG_TASK_PERIOD_MS 20
+
+typedef enum {
+#define DLOG_FMT(id, level, tag, format) id,
+#include "dlog_formats.h"
+#undef DLOG_FMT
+    DLOG_FMT_COUNT
+} dlog_fmt_t;
+
+typedef struct {
+    esp_log_level_t udp_level;      // Records at or above this level are also sent to the server, ESP_LOG_NONE = never
+} dlog_config_t;
+
+typedef struct {
+    uint64_t timestamp_us;          // agv_proto_now_us() when the record was written
+    agv_msg_log_t msg;
+} dlog_entry_t;
+
+typedef struct {
+    uint32_t written;
+    uint32_t dropped;               // Ring full, the formatter task fell behind
+    uint32_t emitted;
+} dlog_stats_t;
+
+/**
+ * @brief Copy one record into the ring of the calling core, never blocks or formats
+ *
+ * Safe from any task or callback; records below the dlog_set_level() threshold are
+ * discarded first thing. Use DLOG() and DLOG_STR() rather than calling this directly.
+ *
+ * @param fmt  Format id from dlog_formats.h
+ * @param str  String for the %s or %H conversion, NULL if none; truncated to AGV_LOG_STR_MAX
+ * @param len  Length of str
+ * @param args Integer arguments in format order
+ * @param n    Number of args, at most AGV_LOG_MAX_ARGS
+ */
+void dlog_write(dlog_fmt_t fmt, const void *str, size_t len, const uint32_t *args, size_t n);
+
+#define DLOG_NARGS(...) (sizeof((const uint32_t[]){0, ##__VA_ARGS__}) / sizeof(uint32_t) - 1)
+
+// Integer arguments only, converted to uint32_t
+#define DLOG(fmt, ...) \
+    dlog_write((fmt), NULL, 0, (const uint32_t[]){0, ##__VA_ARGS__} + 1, DLOG_NARGS(__VA_ARGS__))
+
+// Same with a string or byte buffer for the %s or %H conversion
+#define DLOG_STR(fmt, str, len, ...) \
+    dlog_write((fmt), (str), (len), (const uint32_t[]){0, ##__VA_ARGS__} + 1, DLOG_NARGS(__VA_ARGS__))
+
+/**
+ * @brief Start the formatter task
+ *
+ * Records written before this are kept and emitted once it runs.
+ *
+ * @param config NULL to keep every record on the console
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if already started, or ESP_ERR_NO_MEM
+ */
+esp_err_t dlog_init(const dlog_config_t *config);
+
+/**
+ * @brief Discard records above level at the write, default CONFIG_LOG_DEFAULT_LEVEL
+ */
+void dlog_set_level(esp_log_level_t level);
+
+/**
+ * @brief Take the oldest record of one core, formatter side only
+ *
+ * @return false if every ring is empty
+ */
+bool dlog_read(dlog_entry_t *entry);
+
+/**
+ * @brief Format a record's message without the level, time and tag prefix
+ *
+ * @return Length written, excluding the terminator
+ */
+int dlog_format(const agv_msg_log_t *msg, char *buf, size_t size);
+
+/**
+ * @brief Emit everything queued from the calling task, e.g. before a restart
+ */
+void dlog_flush(void);
+
+/**
+ * @brief Read the ring counters
+ */
+void dlog_get_stats(dlog_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
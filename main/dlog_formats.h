@@ -0,0 +1,17 @@
+// Deferred log formats, included by dlog.h and parsed by dlog_decode.py.
+//
+// DLOG_FMT(id, level, tag, format)
+//
+// Every integer conversion (d i u x X o c, with flags and width) takes one 32-bit
+// argument. %s prints the string given to DLOG_STR(), and %H prints it as hex.
+// A format has at most one string conversion and AGV_LOG_MAX_ARGS integers.
+// There are no floats and no pointers: the arguments are copied raw and formatted later.
+// Append only: the index is the id on the wire.
+
+DLOG_FMT(DLOG_TAG_SENT,             ESP_LOG_INFO,  "hid_keyboard", "Sending RFID tag: %s")
+DLOG_FMT(DLOG_TAG_REPEATED,         ESP_LOG_DEBUG, "hid_keyboard", "Repeated RFID tag: %s")
+DLOG_FMT(DLOG_TAG_WINDOW_FULL,      ESP_LOG_WARN,  "hid_keyboard", "Retransmit window full, sending tag %s without ACK")
+DLOG_FMT(DLOG_TAG_SEND_FAILED,      ESP_LOG_ERROR, "hid_keyboard", "UDP send of tag %s failed: 0x%x")
+DLOG_FMT(DLOG_MOUSE_REPORT,         ESP_LOG_INFO,  "hid_host_app", "Mouse X:%06d Y:%06d |%c|%c|")
+DLOG_FMT(DLOG_GENERIC_REPORT,       ESP_LOG_INFO,  "hid_host_app", "Generic report, %u bytes: %H")
+DLOG_FMT(DLOG_TAG_TOO_LONG,         ESP_LOG_WARN,  "hid_keyboard", "RFID tag %s... of %u characters dropped, more than %u")
@@ -4,14 +4,13 @@
 #include "freertos/queue.h"
 #include "usb/usb_host.h"
 #include "usb/hid_host.h"
-#include <netinet/in.h>
-
-#define RFID_BUFFER_SIZE 64
+#include "hid_keyboard.h"
 
 // Event group identifiers
 typedef enum {
     APP_EVENT = 0,
-    APP_EVENT_HID_HOST
+    APP_EVENT_HID_HOST,
+    APP_EVENT_BOOT_DONE
 } app_event_group_t;
 
 // App event queue structure
@@ -26,10 +25,6 @@ typedef struct {
 
 // Globals used across files
 extern QueueHandle_t app_event_queue;
-extern char rfid_buffer[RFID_BUFFER_SIZE];
-extern int rfid_index;
-extern int udp_sock;
-extern struct sockaddr_in pc_addr;
 
 // Public API (called from main.c)
 void usb_lib_task(void *arg);
@@ -43,6 +38,10 @@ void hid_host_device_event(hid_host_device_handle_t hid_device_handle,
                            const hid_host_driver_event_t event,
                            void *arg);
 
+void hid_host_input_report_callback(hid_host_device_handle_t hid_device_handle,
+                                    const uint8_t *data, size_t length,
+                                    int64_t report_us, void *arg);
+
 void hid_host_interface_callback(hid_host_device_handle_t hid_device_handle,
                                  const hid_host_interface_event_t event,
                                  void *arg);
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include "hid_keyboard.h"
+#include "rfid_frame.h"
+#include "agv_proto.h"
+#include "udp_uplink.h"
+#include "udp_reliable.h"
+#include "tag_dedup.h"
+#include "dlog.h"
+#include "metrics.h"
+
+static void rfid_tag_send(const char *tag, size_t len, void *arg);
+
+static rfid_frame_t rfid_frame = {.on_tag = rfid_tag_send};
+static tag_dedup_t tag_dedup = {.window_us = TAG_DEDUP_DEFAULT_WINDOW_US};
+static uint64_t last_report_us;     // USB completion of the report being decoded
+static uint64_t tag_start_us;       // USB completion of the report that started the tag
+
+void hid_print_new_device_report_header(hid_protocol_t proto) {
+    static hid_protocol_t prev_proto_output = -1;
+    if (prev_proto_output != proto) {
+        prev_proto_output = proto;
+        printf("\r\n");
+        if (proto == HID_PROTOCOL_MOUSE) printf("Mouse\r\n");
+        else if (proto == HID_PROTOCOL_KEYBOARD) printf("Keyboard\r\n");
+        else printf("Generic\r\n");
+        fflush(stdout);
+    }
+}
+
+// One dispatch per completed tag, called from the USB callback context.
+// Repeats of a tag still under the reader are dropped here; the rest bypass
+// the uplink window and are retransmitted until the server acknowledges them.
+// Logging is deferred: the formatter task prints the line later, off this context.
+static void rfid_tag_send(const char *tag, size_t len, void *arg) {
+    agv_msg_tag_t msg;
+    const uint64_t now = agv_proto_now_us();
+
+    // Checked first, so an overlong read never enters the dedup window
+    if (!agv_proto_make_tag(&msg, tag, len)) {
+        DLOG_STR(DLOG_TAG_TOO_LONG, tag, len, len, AGV_PROTO_TAG_MAX);
+        metrics_inc(METRIC_TAGS_TOO_LONG);
+        return;
+    }
+    if (!tag_dedup_check(&tag_dedup, tag, len, now)) {
+        DLOG_STR(DLOG_TAG_REPEATED, tag, len);
+        metrics_inc(METRIC_TAGS_REPEATED);
+        return;
+    }
+    DLOG_STR(DLOG_TAG_SENT, tag, len);
+    msg.usb_us = (uint32_t)(last_report_us - tag_start_us);
+    msg.decode_us = now > last_report_us ? (uint32_t)(now - last_report_us) : 0;
+    metrics_observe(METRIC_TAG_USB_US, msg.usb_us);
+    metrics_observe(METRIC_TAG_DECODE_US, msg.decode_us);
+    esp_err_t err = udp_reliable_post(AGV_MSG_TAG, &msg, sizeof(msg));
+    if (err == ESP_ERR_NO_MEM) {
+        // Too many tags unacknowledged, the server is likely unreachable: still try once
+        DLOG_STR(DLOG_TAG_WINDOW_FULL, tag, len);
+        err = udp_uplink_post(AGV_MSG_TAG, &msg, sizeof(msg), UDP_UPLINK_PRIO_URGENT);
+    }
+    if (err != ESP_OK) DLOG_STR(DLOG_TAG_SEND_FAILED, tag, len, err);
+    else metrics_inc(METRIC_TAGS_SENT);
+}
+
+void hid_keyboard_set_tag_window(uint32_t window_us) {
+    tag_dedup_init(&tag_dedup, window_us);
+}
+
+void hid_keyboard_get_tag_stats(tag_dedup_stats_t *stats) {
+    if (stats) tag_dedup_get_stats(&tag_dedup, stats);
+}
+
+/* ------------ Report handler ------------ */
+
+void hid_host_keyboard_report_callback(const uint8_t *data, const int length, uint64_t report_us) {
+    if (length < 0) return;
+    const uint64_t start_us = agv_proto_now_us();
+    // Provisional until a character lands: the frame may stay empty through key releases
+    if (rfid_frame.len == 0) tag_start_us = report_us;
+    last_report_us = report_us;
+    rfid_frame_feed_report(&rfid_frame, data, (size_t)length);
+    metrics_observe(METRIC_HID_REPORT_US, (uint32_t)(agv_proto_now_us() - start_us));
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include "usb/hid.h"
+#include "tag_dedup.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Print a "Keyboard"/"Mouse"/"Generic" header when the report protocol changes
+ *
+ * @param proto HID protocol of the report about to be printed
+ */
+void hid_print_new_device_report_header(hid_protocol_t proto);
+
+/**
+ * @brief Handle one boot-protocol keyboard input report
+ *
+ * Feeds the report to the RFID frame assembler; each completed tag is posted
+ * through udp_reliable_post(), so it is queued for sending before this returns
+ * and retransmitted until acknowledged.
+ * Repeats of the same tag within the de-duplication window are not posted.
+ * Does not depend on the USB Host driver, so it also builds for the linux target.
+ *
+ * @param data      Raw report data
+ * @param length    Report length in bytes
+ * @param report_us USB completion time of the report, agv_proto_now_us() clock; tags carry
+ *                  the time from their first to their last report and from there to the post
+ */
+void hid_host_keyboard_report_callback(const uint8_t *data, const int length, uint64_t report_us);
+
+/**
+ * @brief Set the tag de-duplication window and forget the tags seen so far
+ *
+ * Call before the first report; the default is TAG_DEDUP_DEFAULT_WINDOW_US.
+ *
+ * @param window_us Repeats of a tag closer together than this are dropped, 0 = default
+ */
+void hid_keyboard_set_tag_window(uint32_t window_us);
+
+/**
+ * @brief Copy the forwarded/suppressed tag counters
+ */
+void hid_keyboard_get_tag_stats(tag_dedup_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
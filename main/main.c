@@ -3,44 +3,135 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_random.h"
 #include "nvs_flash.h"
 #include "driver/gpio.h"
-#include "lwip/sockets.h"
 #include "wifi_service.h"
 #include "udp_service.h"
+#include "udp_uplink.h"
+#include "udp_reliable.h"
+#include "udp_store.h"
 #include "udp_listener.h"
 #include "proxy_sensor.h"
+#include "proxy_sensor_ultrasonic.h"
 #include "hid_host_app.h"
+#include "hid_keyboard.h"
+#include "agv_proto.h"
+#include "boot_trace.h"
+#include "dlog.h"
+#include "metrics.h"
+#include "clock_sync.h"
+#include "rtos_profile.h"
 
 #define APP_QUIT_PIN GPIO_NUM_0
 #define PC_IP_ADDR   "172.16.0.15"
 #define PC_UDP_PORT  8888
+#define AGV_ID       3      // Matches the last byte of the custom STA MAC
+
+#define UPLINK_FLUSH_WINDOW_US  5000    // Longest a sensor event waits to share a datagram
+#define UPLINK_MAX_EVENTS       32
+#define STORE_CAPACITY          16384   // Bytes of events kept while Wi-Fi is down
+
+#define DLOG_UDP_LEVEL          ESP_LOG_WARN    // Deferred log records also sent to the server
+
+#define METRICS_PERIOD_MS       10000   // Counters and histograms to the server
+#define PROFILE_PERIOD_MS       10000   // Task CPU shares, stack and heap low-water marks to the server
+
+#define RFID_TAG_WINDOW_US      2000000 // A tag read again within this is not re-sent
+
+// Ultrasonic sensors: {trig, echo, sensor_id}, zone assignment below
+#define PROXY_FRONT_TRIG_PIN    GPIO_NUM_4
+#define PROXY_FRONT_ECHO_PIN    GPIO_NUM_5
+#define PROXY_REAR_TRIG_PIN     GPIO_NUM_6
+#define PROXY_REAR_ECHO_PIN     GPIO_NUM_7
 
 static const char *TAG = "main";
 
-void app_main(void) {
-    ESP_ERROR_CHECK(nvs_flash_init());
-    wifi_service_init();
+// Runs in whichever task finished the last stage, or at the deadline in the esp_timer task,
+// so the report is left to the main loop
+static void app_boot_done(void *arg) {
+    const app_event_queue_t evt_queue={.event_group=APP_EVENT_BOOT_DONE};
+    if (!app_event_queue) return;
+    if (xQueueSend(app_event_queue,&evt_queue,0)!=pdTRUE) metrics_inc(METRIC_APP_QUEUE_DROPS);
+    else rtos_profile_queue_depth(uxQueueMessagesWaiting(app_event_queue));
+}
 
-    // UDP init
-    udp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (udp_sock < 0) ESP_LOGE(TAG,"Unable to create socket: errno %d", errno);
-    else ESP_LOGI(TAG,"UDP socket created");
+// Offline the trace waits in the store like any other event
+static void app_boot_report(void) {
+    agv_msg_boot_t msg;
+    boot_trace_report();
+    boot_trace_encode(&msg);
+    udp_uplink_post(AGV_MSG_BOOT,&msg,sizeof(msg),UDP_UPLINK_PRIO_URGENT);
+}
 
-    memset(&pc_addr,0,sizeof(pc_addr));
-    pc_addr.sin_family=AF_INET;
-    pc_addr.sin_port=htons(PC_UDP_PORT);
-    inet_pton(AF_INET,PC_IP_ADDR,&pc_addr.sin_addr);
+// Runs in the default event loop task, and from app_main through app_link_sync()
+static void app_link_changed(bool connected, void *arg) {
+    udp_store_set_online(connected);
+    udp_reliable_set_paused(!connected);
+    clock_sync_set_paused(!connected);
+    metrics_set_paused(!connected);
+    rtos_profile_set_paused(!connected);
+    if (connected) boot_trace_end(BOOT_STAGE_WIFI_CONNECT);
+}
 
-    ESP_ERROR_CHECK(udp_service_init(PC_IP_ADDR,PC_UDP_PORT));
-    udp_service_send(rfid_buffer,strlen(rfid_buffer));
+// The link may have changed before the services above could follow it. Re-read until the
+// state holds, in case the event loop task reported a change while this applied the old one.
+static void app_link_sync(void) {
+    bool connected;
+    do {
+        connected=wifi_service_is_connected();
+        app_link_changed(connected,NULL);
+    } while (connected!=wifi_service_is_connected());
+}
 
-    xTaskCreate(udp_listener_task,"udp_listener_task",4096,NULL,5,NULL);
+void app_main(void) {
+    static proxy_ultrasonic_t proxy_ultrasonic;
+    static proxy_sensor_backend_t proxy_backend;
+    static proxy_sensor_params_t proxy_params;
 
-    proxy_sensor_params_t proxy_params={.udp_sock=udp_sock,.pc_addr=pc_addr};
-    xTaskCreate(proxy_sensor_task,"proxy_sensor_task",4096,&proxy_params,5,NULL);
+    // Device callbacks and the boot trace post here, the main loop drains it once everything is up
+    app_event_queue=xQueueCreate(10,sizeof(app_event_queue_t));
+    if (!app_event_queue) ESP_LOGE(TAG,"Failed to create app_event_queue");
+    ESP_ERROR_CHECK(boot_trace_init(BOOT_TRACE_DEFAULT_DEADLINE_US,app_boot_done,NULL));
+    boot_trace_begin(BOOT_STAGE_NVS);
+    ESP_ERROR_CHECK(nvs_flash_init());
+    boot_trace_end(BOOT_STAGE_NVS);
+    agv_proto_init(AGV_ID,esp_random());
+
+    // Association takes longest and runs in the background while everything else comes up
+    boot_trace_begin(BOOT_STAGE_WIFI_INIT);
+    boot_trace_begin(BOOT_STAGE_WIFI_CONNECT);
+    wifi_service_set_link_cb(app_link_changed,NULL);
+    wifi_service_init();
+    boot_trace_end(BOOT_STAGE_WIFI_INIT);
+
+    // Until the link is up everything produced below waits in the offline store
+    boot_trace_begin(BOOT_STAGE_UPLINK);
+    // The listener must be running before the transport task can hand it server commands
+    xTaskCreate(udp_listener_task,"udp_listener_task",4096,NULL,5,NULL);
 
-    // HID Host setup
+    // One transport task owns the socket for both directions
+    ESP_ERROR_CHECK(udp_service_init(PC_IP_ADDR,PC_UDP_PORT,udp_listener_on_datagram,NULL));
+
+    // Events queue up in the store while Wi-Fi is down and leave in order once it is back
+    const udp_store_config_t store_config={.send=udp_service_send,.capacity=STORE_CAPACITY,
+                                           .overflow=UDP_STORE_DROP_OLDEST};
+    ESP_ERROR_CHECK(udp_store_init(&store_config));
+    const udp_uplink_config_t uplink_config={.send=udp_store_send,
+                                             .flush_window_us=UPLINK_FLUSH_WINDOW_US,
+                                             .max_events=UPLINK_MAX_EVENTS};
+    ESP_ERROR_CHECK(udp_uplink_init(&uplink_config));
+    ESP_ERROR_CHECK(udp_reliable_init(NULL));
+    ESP_ERROR_CHECK(clock_sync_init(NULL));
+    const dlog_config_t dlog_config={.udp_level=DLOG_UDP_LEVEL};
+    ESP_ERROR_CHECK(dlog_init(&dlog_config));
+    ESP_ERROR_CHECK(metrics_init(METRICS_PERIOD_MS));
+    app_link_sync();
+    udp_uplink_post(AGV_MSG_HELLO,NULL,0,UDP_UPLINK_PRIO_URGENT);
+    boot_trace_end(BOOT_STAGE_UPLINK);
+
+    // The RFID reader is the point of the AGV, bring it up before the sensors
+    boot_trace_begin(BOOT_STAGE_USB_HOST);
     const gpio_config_t input_pin={.pin_bit_mask=BIT64(APP_QUIT_PIN),.mode=GPIO_MODE_INPUT,
                                    .pull_up_en=GPIO_PULLUP_ENABLE,.intr_type=GPIO_INTR_NEGEDGE};
     ESP_ERROR_CHECK(gpio_config(&input_pin));
@@ -51,14 +142,33 @@ void app_main(void) {
                                                     xTaskGetCurrentTaskHandle(),2,NULL,0);
     assert(task_created==pdTRUE);
     ulTaskNotifyTake(false,1000/portTICK_PERIOD_MS);
+    boot_trace_end(BOOT_STAGE_USB_HOST);
 
+    boot_trace_begin(BOOT_STAGE_HID);
+    hid_keyboard_set_tag_window(RFID_TAG_WINDOW_US);
     const hid_host_driver_config_t hid_host_driver_config={
         .create_background_task=true,.task_priority=5,.stack_size=4096,.core_id=0,
         .callback=hid_host_device_callback,.callback_arg=NULL};
     ESP_ERROR_CHECK(hid_host_install(&hid_host_driver_config));
+    boot_trace_end(BOOT_STAGE_HID);
+
+    // Front and rear face away from each other, so both can ping every period
+    boot_trace_begin(BOOT_STAGE_SENSORS);
+    const proxy_ultrasonic_config_t proxy_config={
+        .channels={{PROXY_FRONT_TRIG_PIN,PROXY_FRONT_ECHO_PIN,0},{PROXY_REAR_TRIG_PIN,PROXY_REAR_ECHO_PIN,1}},
+        .num_channels=2,.schedule=PROXY_ULTRASONIC_CONCURRENT,.period_us=PROXY_ULTRASONIC_DEFAULT_PERIOD_US,
+        .idle_period_us=PROXY_ULTRASONIC_IDLE_PERIOD_US};
+    proxy_ultrasonic_backend(&proxy_ultrasonic,&proxy_config,&proxy_backend);
+    proxy_params=(proxy_sensor_params_t){
+        .backends={&proxy_backend},.num_backends=1,
+        .channels={{0,PROXY_ZONE_FRONT},{1,PROXY_ZONE_REAR}},.num_channels=2,
+        .zones=PROXY_SENSOR_ZONES_DEFAULT()};
+    xTaskCreate(proxy_sensor_task,"proxy_sensor_task",4096,&proxy_params,5,NULL);
+    boot_trace_end(BOOT_STAGE_SENSORS);
 
-    app_event_queue=xQueueCreate(10,sizeof(app_event_queue_t));
-    if (!app_event_queue) ESP_LOGE(TAG,"Failed to create app_event_queue");
+    // Last, so the first report already sees every task
+    const rtos_profile_config_t profile_config={.period_ms=PROFILE_PERIOD_MS,.queue=app_event_queue};
+    ESP_ERROR_CHECK(rtos_profile_init(&profile_config));
 
     ESP_LOGI(TAG,"Waiting for HID Device...");
 
@@ -76,6 +186,7 @@ void app_main(void) {
                                       evt_queue.hid_host_device.event,
                                       evt_queue.hid_host_device.arg);
             }
+            if (APP_EVENT_BOOT_DONE==evt_queue.event_group) app_boot_report();
         }
     }
 
@@ -83,8 +194,12 @@ void app_main(void) {
     ESP_ERROR_CHECK(hid_host_uninstall());
     gpio_isr_handler_remove(APP_QUIT_PIN);
 
+    rtos_profile_deinit();
     if (app_event_queue){xQueueReset(app_event_queue);vQueueDelete(app_event_queue);app_event_queue=NULL;}
-    if (udp_sock>=0){ESP_LOGI(TAG,"Closing UDP socket");close(udp_sock);udp_sock=-1;}
+    udp_reliable_deinit();
+    udp_uplink_deinit();
+    udp_store_deinit();
+    udp_service_deinit();
 
     ESP_LOGI(TAG,"Application finished.");
 }
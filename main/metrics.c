@@ -0,0 +1,94 @@
+// metrics.c
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "udp_uplink.h"
+#include "metrics.h"
+
+static const char *TAG = "metrics";
+
+typedef struct {
+    uint32_t max_us;
+    uint32_t buckets[AGV_HIST_BUCKETS];
+} metrics_histogram_t;
+
+uint32_t metrics_counters[METRIC_COUNTER_COUNT];
+static metrics_histogram_t histograms[METRIC_HISTOGRAM_COUNT];
+static TaskHandle_t export_task_handle;
+static uint32_t export_period_ms;
+static bool paused = true;      // Link down, see metrics_set_paused()
+
+void metrics_observe(metric_histogram_t id, uint32_t value_us) {
+    if (id >= METRIC_HISTOGRAM_COUNT) return;
+    metrics_histogram_t *hist = &histograms[id];
+    const int bucket = value_us ? 32 - __builtin_clz(value_us) : 0;
+    __atomic_fetch_add(&hist->buckets[bucket < AGV_HIST_BUCKETS ? bucket : AGV_HIST_BUCKETS - 1], 1,
+                       __ATOMIC_RELAXED);
+
+    uint32_t max = __atomic_load_n(&hist->max_us, __ATOMIC_RELAXED);
+    while (value_us > max && !__atomic_compare_exchange_n(&hist->max_us, &max, value_us, true,
+                                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void metrics_snapshot(agv_msg_metrics_t *counters, agv_msg_histogram_t *hist) {
+    memset(counters, 0, sizeof(*counters));
+    counters->uptime_ms = (uint32_t)(agv_proto_now_us() / 1000);
+    counters->count = METRIC_COUNTER_COUNT;
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        counters->counters[i] = __atomic_load_n(&metrics_counters[i], __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+        memset(&hist[i], 0, sizeof(hist[i]));
+        hist[i].id = i;
+        hist[i].max_us = __atomic_load_n(&histograms[i].max_us, __ATOMIC_RELAXED);
+        for (int b = 0; b < AGV_HIST_BUCKETS; b++) {
+            hist[i].buckets[b] = __atomic_load_n(&histograms[i].buckets[b], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+esp_err_t metrics_export(void) {
+    static agv_msg_metrics_t counters;      // Export runs in one task at a time, metrics or the caller
+    static agv_msg_histogram_t hist[METRIC_HISTOGRAM_COUNT];
+
+    metrics_snapshot(&counters, hist);
+    // Normal priority and a flush: one datagram, shared with whatever else is pending
+    esp_err_t err = udp_uplink_post(AGV_MSG_METRICS, &counters, sizeof(counters), UDP_UPLINK_PRIO_NORMAL);
+    for (int i = 0; i < METRIC_HISTOGRAM_COUNT && err == ESP_OK; i++) {
+        err = udp_uplink_post(AGV_MSG_HISTOGRAM, &hist[i], sizeof(hist[i]), UDP_UPLINK_PRIO_NORMAL);
+    }
+    udp_uplink_flush();
+    return err;
+}
+
+// Its own task: a report is a burst of posts that may wait on the uplink, which no timer callback may do
+static void metrics_task(void *arg) {
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(export_period_ms));
+        // Totals, nothing is lost by skipping; stored reports would only push out tags and zones
+        if (__atomic_load_n(&paused, __ATOMIC_RELAXED)) continue;
+        esp_err_t err = metrics_export();
+        if (err != ESP_OK) ESP_LOGW(TAG, "Export failed: %s", esp_err_to_name(err));
+    }
+}
+
+esp_err_t metrics_init(uint32_t period_ms) {
+    if (export_task_handle) return ESP_ERR_INVALID_STATE;
+    if (period_ms == 0) period_ms = METRICS_DEFAULT_PERIOD_MS;
+    export_period_ms = period_ms;
+
+    if (xTaskCreate(metrics_task, "metrics", METRICS_TASK_STACK, NULL, METRICS_TASK_PRIORITY,
+                    &export_task_handle) != pdPASS) {
+        export_task_handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "%d counters, %d histograms every %u ms", METRIC_COUNTER_COUNT, METRIC_HISTOGRAM_COUNT,
+             (unsigned)period_ms);
+    return ESP_OK;
+}
+
+void metrics_set_paused(bool pause) {
+    __atomic_store_n(&paused, pause, __ATOMIC_RELAXED);
+}
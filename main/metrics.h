@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "agv_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_DEFAULT_PERIOD_MS   10000
+#define METRICS_TASK_STACK          2048
+#define METRICS_TASK_PRIORITY       1           // A report can wait, producers cannot
+
+typedef enum {
+#define METRIC_COUNTER(id, name) id,
+#define METRIC_HISTOGRAM(id, name)
+#include "metrics_defs.h"
+#undef METRIC_COUNTER
+#undef METRIC_HISTOGRAM
+    METRIC_COUNTER_COUNT
+} metric_counter_t;
+
+typedef enum {
+#define METRIC_COUNTER(id, name)
+#define METRIC_HISTOGRAM(id, name) id,
+#include "metrics_defs.h"
+#undef METRIC_COUNTER
+#undef METRIC_HISTOGRAM
+    METRIC_HISTOGRAM_COUNT
+} metric_histogram_t;
+
+_Static_assert(METRIC_COUNTER_COUNT <= AGV_METRICS_MAX_COUNTERS, "AGV_MSG_METRICS has no room for every counter");
+
+// Only through metrics_add(), inline so a count is one atomic add on the hot path
+extern uint32_t metrics_counters[METRIC_COUNTER_COUNT];
+
+/**
+ * @brief Add to a counter, lock-free and safe from ISRs
+ */
+static inline void metrics_add(metric_counter_t id, uint32_t n) {
+    __atomic_fetch_add(&metrics_counters[id], n, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_inc(metric_counter_t id) {
+    metrics_add(id, 1);
+}
+
+/**
+ * @brief Count a duration in its log2 bucket, lock-free and safe from ISRs
+ */
+void metrics_observe(metric_histogram_t id, uint32_t value_us);
+
+/**
+ * @brief Start a task sending every counter and histogram through the uplink each period
+ *
+ * udp_uplink_init() must have been called. Values are totals since boot, the
+ * server takes differences, so a lost report only costs resolution.
+ *
+ * @param period_ms Export period, 0 = default
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if already started, or ESP_ERR_NO_MEM
+ */
+esp_err_t metrics_init(uint32_t period_ms);
+
+/**
+ * @brief Skip the periodic exports while the link is down
+ *
+ * They would fill the offline store and push out older messages. Starts paused.
+ */
+void metrics_set_paused(bool paused);
+
+/**
+ * @brief Fill the export payloads, hist must hold METRIC_HISTOGRAM_COUNT entries
+ */
+void metrics_snapshot(agv_msg_metrics_t *counters, agv_msg_histogram_t *hist);
+
+/**
+ * @brief Send one report now
+ */
+esp_err_t metrics_export(void);
+
+#ifdef __cplusplus
+}
+#endif
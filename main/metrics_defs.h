@@ -0,0 +1,31 @@
+// Metrics exported in AGV_MSG_METRICS and AGV_MSG_HISTOGRAM, included by metrics.h and parsed by udp.py.
+//
+// METRIC_COUNTER(id, name)    monotonic count since boot
+// METRIC_HISTOGRAM(id, name)  log2 buckets of a duration in microseconds
+//
+// Append only: the position in each list is the index on the wire.
+
+METRIC_COUNTER(METRIC_HID_REPORTS,          "hid_reports")
+METRIC_COUNTER(METRIC_HID_TRANSFER_ERRORS,  "hid_transfer_errors")
+METRIC_COUNTER(METRIC_APP_QUEUE_DROPS,      "app_queue_drops")
+METRIC_COUNTER(METRIC_TAGS_SENT,            "tags_sent")
+METRIC_COUNTER(METRIC_TAGS_REPEATED,        "tags_repeated")
+METRIC_COUNTER(METRIC_UDP_TX_QUEUED,        "udp_tx_queued")
+METRIC_COUNTER(METRIC_UDP_TX_DROPPED,       "udp_tx_dropped")
+METRIC_COUNTER(METRIC_UDP_TX_ERRORS,        "udp_tx_errors")
+METRIC_COUNTER(METRIC_UDP_RX_DATAGRAMS,     "udp_rx_datagrams")
+METRIC_COUNTER(METRIC_COMMANDS,             "commands")
+METRIC_COUNTER(METRIC_COMMANDS_DROPPED,     "commands_dropped")
+METRIC_COUNTER(METRIC_PROXY_SAMPLES,        "proxy_samples")
+METRIC_COUNTER(METRIC_PROXY_ZONE_CHANGES,   "proxy_zone_changes")
+METRIC_COUNTER(METRIC_TAGS_TOO_LONG,        "tags_too_long")        // Longer than AGV_PROTO_TAG_MAX, dropped
+
+METRIC_HISTOGRAM(METRIC_HID_REPORT_US,      "hid_report_us")        // Keyboard report callback, decode and tag send
+METRIC_HISTOGRAM(METRIC_UDP_SENDTO_US,      "udp_sendto_us")        // One sendto() in the transport task
+METRIC_HISTOGRAM(METRIC_COMMAND_WAIT_US,    "command_wait_us")      // Command received to executed
+METRIC_HISTOGRAM(METRIC_PROXY_LATENCY_US,   "proxy_latency_us")     // Ping to zone change posted
+METRIC_HISTOGRAM(METRIC_TAG_USB_US,         "tag_usb_us")           // Tag's first to last report, USB completions
+METRIC_HISTOGRAM(METRIC_TAG_DECODE_US,      "tag_decode_us")        // Last report's USB completion to tag posted
+METRIC_HISTOGRAM(METRIC_TAG_QUEUE_US,       "tag_queue_us")         // Tag posted to sendto() of the acknowledged copy
+METRIC_HISTOGRAM(METRIC_TAG_WIFI_US,        "tag_wifi_us")          // Half the round trip, server hold time excluded
+METRIC_HISTOGRAM(METRIC_TAG_SERVER_US,      "tag_server_us")        // Server receive to ACK sent
@@ -0,0 +1,93 @@
+// proxy_filter.c
+#include <string.h>
+#include "proxy_filter.h"
+
+static uint16_t filter_median(const proxy_filter_t *filter) {
+    uint16_t sorted[PROXY_FILTER_MEDIAN_MAX];
+    const uint8_t n = filter->window_fill;
+
+    // Insertion sort, at most five elements
+    for (uint8_t i = 0; i < n; i++) {
+        uint16_t v = filter->window[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    return sorted[n / 2];
+}
+
+void proxy_filter_init(proxy_filter_t *filter, const proxy_filter_config_t *config) {
+    memset(filter, 0, sizeof(*filter));
+    filter->config = *config;
+    if (filter->config.median_window == 0) filter->config.median_window = 1;
+    if (filter->config.median_window > PROXY_FILTER_MEDIAN_MAX) filter->config.median_window = PROXY_FILTER_MEDIAN_MAX;
+    if (filter->config.exit_mm < filter->config.enter_mm) filter->config.exit_mm = filter->config.enter_mm;
+}
+
+bool proxy_filter_smooth(proxy_filter_t *filter, uint16_t distance_mm) {
+    const proxy_filter_config_t *config = &filter->config;
+
+    // A lost echo says little on its own, only a run of them means the path is clear
+    if (distance_mm > config->max_range_mm) {
+        // Stops counting at the limit, a run of any length must not wrap back to ignored
+        if (filter->dropouts < config->max_dropouts) {
+            filter->dropouts++;
+            return false;
+        }
+        distance_mm = config->max_range_mm;
+    } else {
+        filter->dropouts = 0;
+    }
+
+    // Median rejects isolated spikes
+    filter->window[filter->window_pos] = distance_mm;
+    filter->window_pos = (filter->window_pos + 1) % config->median_window;
+    if (filter->window_fill < config->median_window) filter->window_fill++;
+    uint16_t value = filter_median(filter);
+
+    // EMA smooths what is left
+    if (config->ema_shift) {
+        if (!filter->ema_valid) {
+            filter->ema_q8 = (int32_t)value << 8;
+            filter->ema_valid = true;
+        } else {
+            filter->ema_q8 += (((int32_t)value << 8) - filter->ema_q8) >> config->ema_shift;
+        }
+        value = (uint16_t)((filter->ema_q8 + 128) >> 8);
+    }
+    filter->filtered_mm = value;
+    return true;
+}
+
+proxy_filter_event_t proxy_threshold_update(proxy_threshold_t *threshold, const proxy_threshold_config_t *config,
+                                            uint16_t distance_mm, uint64_t timestamp_us) {
+    // Enter and exit both need the threshold held for min_dwell_us
+    const bool past = threshold->triggered ? distance_mm >= config->exit_mm : distance_mm <= config->enter_mm;
+    if (!past) {
+        threshold->crossing = false;
+        return PROXY_FILTER_NONE;
+    }
+    if (!threshold->crossing) {
+        threshold->crossing = true;
+        threshold->crossing_since_us = timestamp_us;
+    }
+    if (timestamp_us - threshold->crossing_since_us < config->min_dwell_us) return PROXY_FILTER_NONE;
+
+    threshold->crossing = false;
+    threshold->triggered = !threshold->triggered;
+    return threshold->triggered ? PROXY_FILTER_ENTER : PROXY_FILTER_EXIT;
+}
+
+proxy_filter_event_t proxy_filter_update(proxy_filter_t *filter, uint16_t distance_mm, uint64_t timestamp_us) {
+    const proxy_threshold_config_t threshold_config = {
+        .enter_mm = filter->config.enter_mm,
+        .exit_mm = filter->config.exit_mm,
+        .min_dwell_us = filter->config.min_dwell_us,
+    };
+
+    if (!proxy_filter_smooth(filter, distance_mm)) return PROXY_FILTER_NONE;
+    return proxy_threshold_update(&filter->threshold, &threshold_config, filter->filtered_mm, timestamp_us);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROXY_FILTER_MEDIAN_MAX 5
+
+typedef struct {
+    uint8_t median_window;      // Odd, 1 = off, up to PROXY_FILTER_MEDIAN_MAX
+    uint8_t ema_shift;          // EMA weight 1/2^ema_shift for the new sample, 0 = off
+    uint16_t enter_mm;          // Trigger at or below this filtered distance
+    uint16_t exit_mm;           // Re-arm at or above this filtered distance, > enter_mm
+    uint32_t min_dwell_us;      // Time the filtered distance must stay past a threshold to switch
+    uint16_t max_range_mm;      // Value used for samples without an echo
+    uint8_t max_dropouts;       // Consecutive samples without an echo ignored before using max_range_mm
+} proxy_filter_config_t;
+
+// Hysteresis and dwell on an already smoothed distance
+typedef struct {
+    uint16_t enter_mm;          // Trigger at or below this distance
+    uint16_t exit_mm;           // Re-arm at or above this distance, >= enter_mm
+    uint32_t min_dwell_us;      // Time the distance must stay past a threshold to switch
+} proxy_threshold_config_t;
+
+typedef struct {
+    bool crossing;              // Distance is past the next threshold, dwell running
+    bool triggered;             // ENTER reported, waiting for exit_mm
+    uint64_t crossing_since_us;
+} proxy_threshold_t;
+
+typedef enum {
+    PROXY_FILTER_NONE = 0,
+    PROXY_FILTER_ENTER,         // Object came within enter_mm and stayed for min_dwell_us
+    PROXY_FILTER_EXIT,          // Object moved back beyond exit_mm and stayed for min_dwell_us
+} proxy_filter_event_t;
+
+// Filter state, one per sensor. Integer only, safe to run at any sample rate.
+typedef struct {
+    proxy_filter_config_t config;
+    uint16_t window[PROXY_FILTER_MEDIAN_MAX];
+    uint8_t window_fill;
+    uint8_t window_pos;
+    int32_t ema_q8;             // EMA in 1/256 mm
+    bool ema_valid;
+    uint8_t dropouts;           // Consecutive samples without an echo, up to max_dropouts
+    proxy_threshold_t threshold;
+    uint16_t filtered_mm;       // Last filter output
+} proxy_filter_t;
+
+/**
+ * @brief Reset a filter
+ */
+void proxy_filter_init(proxy_filter_t *filter, const proxy_filter_config_t *config);
+
+/**
+ * @brief Median and EMA stages only, for callers with their own thresholds
+ *
+ * @param filter       Filter state, enter_mm/exit_mm/min_dwell_us are not used
+ * @param distance_mm  Raw distance, anything above max_range_mm (e.g. UINT16_MAX) for no echo
+ * @return true if filter->filtered_mm was updated, false for an ignored dropout
+ */
+bool proxy_filter_smooth(proxy_filter_t *filter, uint16_t distance_mm);
+
+/**
+ * @brief Run one hysteresis/dwell stage on a smoothed distance
+ */
+proxy_filter_event_t proxy_threshold_update(proxy_threshold_t *threshold, const proxy_threshold_config_t *config,
+                                            uint16_t distance_mm, uint64_t timestamp_us);
+
+/**
+ * @brief Feed one raw sample through smoothing and the configured thresholds
+ *
+ * @param filter       Filter state
+ * @param distance_mm  Raw distance, anything above max_range_mm (e.g. UINT16_MAX) for no echo
+ * @param timestamp_us Sample time, monotonic
+ * @return Trigger transition caused by this sample, if any
+ */
+proxy_filter_event_t proxy_filter_update(proxy_filter_t *filter, uint16_t distance_mm, uint64_t timestamp_us);
+
+#ifdef __cplusplus
+}
+#endif
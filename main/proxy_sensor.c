@@ -1,59 +1,141 @@
 // proxy_sensor.c
-#include "wifi_service.h"
 #include "proxy_sensor.h"
+#include "agv_proto.h"
+#include "udp_uplink.h"
+#include "metrics.h"
 #include "esp_log.h"
-#include "freertos/event_groups.h"
+#include "freertos/queue.h"
 #include <string.h>
-#include <sys/socket.h>
 
+static const char *TAG = "proxy_sensor";
 
-extern EventGroupHandle_t wifi_event_group;
+static QueueHandle_t sample_queue;
+static proxy_sensor_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
 
-static const char *TAG = "proxy_sensor";
+bool proxy_sensor_submit(const proxy_sensor_sample_t *sample) {
+    if (!sample_queue) return false;
+    if (xQueueSend(sample_queue, sample, 0) != pdTRUE) {
+        taskENTER_CRITICAL(&stats_lock);
+        stats.dropped++;
+        taskEXIT_CRITICAL(&stats_lock);
+        return false;
+    }
+    return true;
+}
+
+bool proxy_sensor_submit_from_isr(const proxy_sensor_sample_t *sample, BaseType_t *higher_prio_woken) {
+    if (!sample_queue) return false;
+    if (xQueueSendFromISR(sample_queue, sample, higher_prio_woken) != pdTRUE) {
+        taskENTER_CRITICAL_ISR(&stats_lock);
+        stats.dropped++;
+        taskEXIT_CRITICAL_ISR(&stats_lock);
+        return false;
+    }
+    return true;
+}
+
+void proxy_sensor_get_stats(proxy_sensor_stats_t *out) {
+    if (!out) return;
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+static void proxy_sensor_set_active(const proxy_sensor_params_t *params, bool active) {
+    for (int i = 0; i < params->num_backends; i++) {
+        const proxy_sensor_backend_t *backend = params->backends[i];
+        if (backend->set_active) backend->set_active(backend->ctx, active);
+    }
+}
+
+static void proxy_sensor_send_change(const proxy_zone_change_t *change, uint64_t sample_us) {
+    static const char *const zone_names[PROXY_ZONE_COUNT] = {"front", "rear", "left", "right"};
+    static const char *const state_names[PROXY_ZONE_STATE_COUNT] = {"clear", "slow", "stop"};
+
+    const agv_msg_zone_t msg = {
+        .zone = change->zone,
+        .state = change->state,
+        .prev_state = change->prev_state,
+        .sensor_id = change->sensor_id,
+        .distance = change->distance_mm,
+    };
+
+    // Stamped with the ping, so the server places the obstacle where the AGV was, not where it is now
+    esp_err_t err = udp_uplink_post_seq(AGV_MSG_ZONE, agv_proto_next_seq(), udp_uplink_event_us(sample_us),
+                                        &msg, sizeof(msg),
+                                        change->state == PROXY_ZONE_STOP ? UDP_UPLINK_PRIO_URGENT
+                                                                         : UDP_UPLINK_PRIO_NORMAL);
+    // Ping to post: echo flight time, queue wait and filtering
+    const uint32_t latency_us = (uint32_t)(agv_proto_now_us() - sample_us);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to queue zone change: %s", esp_err_to_name(err));
+    } else {
+        taskENTER_CRITICAL(&stats_lock);
+        stats.zone_changes++;
+        stats.last_latency_us = latency_us;
+        stats.total_latency_us += latency_us;
+        if (latency_us > stats.max_latency_us) stats.max_latency_us = latency_us;
+        taskEXIT_CRITICAL(&stats_lock);
+        metrics_inc(METRIC_PROXY_ZONE_CHANGES);
+        metrics_observe(METRIC_PROXY_LATENCY_US, latency_us);
+    }
+
+    ESP_LOGI(TAG, "%s zone %s -> %s (sensor %d, %u mm, %lu us)", zone_names[change->zone],
+             state_names[change->prev_state], state_names[change->state], change->sensor_id,
+             change->distance_mm, (unsigned long)latency_us);
+}
 
 void proxy_sensor_task(void *pvParameters) {
-    proxy_sensor_params_t *params = (proxy_sensor_params_t *) pvParameters;
-    int udp_sock = params->udp_sock;
-    struct sockaddr_in pc_addr = params->pc_addr;
+    const proxy_sensor_params_t *params = (const proxy_sensor_params_t *) pvParameters;
+    static proxy_zone_fusion_t fusion;  // Kept off the task stack
 
-    ESP_LOGI(TAG, "Proxy sensor task started");
+    proxy_zone_init(&fusion, &params->zones);
+    for (int i = 0; i < params->num_channels; i++) {
+        if (!proxy_zone_add_channel(&fusion, params->channels[i].sensor_id, params->channels[i].zone)) {
+            ESP_LOGE(TAG, "Invalid channel: sensor %d zone %d", params->channels[i].sensor_id, params->channels[i].zone);
+        }
+    }
 
-    int simulated_distance = 0; // Simulated sensor value
-    bool triggered_once_flag = false; // Ensure UDP sends only once per trigger
+    sample_queue = xQueueCreate(PROXY_SENSOR_QUEUE_LEN, sizeof(proxy_sensor_sample_t));
+    if (!sample_queue) {
+        ESP_LOGE(TAG, "Failed to create sample queue");
+        vTaskDelete(NULL);
+    }
+    for (int i = 0; i < params->num_backends; i++) {
+        const proxy_sensor_backend_t *backend = params->backends[i];
+        esp_err_t err = backend->start(backend->ctx);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start %s backend: %s", backend->name, esp_err_to_name(err));
+        }
+    }
+
+    ESP_LOGI(TAG, "Proxy sensor task started, %d channels", params->num_channels);
 
+    proxy_sensor_sample_t sample;
+    proxy_zone_change_t change;
+    bool active = false;
     while (1) {
-        // Wait for Wi-Fi to be connected
-        xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
-
-        // Simulate sensor reading
-        simulated_distance = (simulated_distance + 1) % 100;
-
-        // Approx. 2 feet trigger range
-        if (simulated_distance >= 23 && simulated_distance <= 25) {
-            if (!triggered_once_flag) {
-                if (udp_sock >= 0) {
-                    char sensor_data[64];
-                    snprintf(sensor_data, sizeof(sensor_data), "TRIGGERED_DISTANCE: %d (approx 2ft)", simulated_distance);
-
-                    ESP_LOGI(TAG, "Sending triggered sensor data: %s", sensor_data);
-                    int err = sendto(udp_sock, sensor_data, strlen(sensor_data), 0,
-                                     (struct sockaddr *)&pc_addr, sizeof(pc_addr));
-                    if (err < 0) {
-                        ESP_LOGE(TAG, "Failed to send triggered sensor data: errno %d", errno);
-                    } else {
-                        ESP_LOGI(TAG, "Sent %d bytes of triggered sensor data", err);
-                    }
-                } else {
-                    ESP_LOGW(TAG, "UDP socket not ready for triggered sensor data.");
-                }
-                triggered_once_flag = true;
-            }
-        } else {
-            triggered_once_flag = false;
+        // Woken by every sample, no polling interval
+        if (xQueueReceive(sample_queue, &sample, portMAX_DELAY) != pdTRUE) continue;
+
+        taskENTER_CRITICAL(&stats_lock);
+        stats.samples++;
+        taskEXIT_CRITICAL(&stats_lock);
+        metrics_inc(METRIC_PROXY_SAMPLES);
+
+        if (proxy_zone_update(&fusion, sample.sensor_id, sample.distance_mm, sample.timestamp_us, &change)) {
+            proxy_sensor_send_change(&change, sample.timestamp_us);
         }
 
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        // Checked on every sample, the first close echo must not wait for the filter
+        const bool near = proxy_zone_active(&fusion);
+        if (near != active) {
+            active = near;
+            proxy_sensor_set_active(params, active);
+        }
     }
 
+    for (int i = 0; i < params->num_backends; i++) params->backends[i]->stop(params->backends[i]->ctx);
     vTaskDelete(NULL);
 }
@@ -1,23 +1,104 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include <sys/socket.h>
-#include <netinet/in.h>  // Must come AFTER sys/socket.h
+#include "esp_err.h"
+#include "proxy_zone.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define PROXY_SENSOR_NO_ECHO        UINT16_MAX  // Nothing in range
+#define PROXY_SENSOR_QUEUE_LEN      32
+#define PROXY_SENSOR_MAX_BACKENDS   4
+
+typedef struct {
+    uint8_t sensor_id;
+    uint16_t distance_mm;       // PROXY_SENSOR_NO_ECHO if nothing is in range
+    uint64_t timestamp_us;      // agv_proto_now_us() when the sample was taken
+} proxy_sensor_sample_t;
+
+/**
+ * @brief Sample source
+ *
+ * start() begins producing samples through proxy_sensor_submit() or
+ * proxy_sensor_submit_from_isr() and must not block; stop() ends it.
+ * set_active() is optional: the sensor task calls it with true on the
+ * first echo inside the slow zone's exit distance and with false once
+ * nothing is that close and every zone is clear, so a backend can sample
+ * slower while nothing is near.
+ */
+typedef struct {
+    const char *name;
+    esp_err_t (*start)(void *ctx);
+    void (*stop)(void *ctx);
+    void (*set_active)(void *ctx, bool active);
+    void *ctx;
+} proxy_sensor_backend_t;
+
+typedef struct {
+    uint32_t samples;           // Taken off the queue
+    uint32_t dropped;           // Lost to a full queue
+    uint32_t zone_changes;      // ZONE messages posted
+    uint32_t last_latency_us;   // Sample timestamp to ZONE message posted
+    uint32_t max_latency_us;
+    uint64_t total_latency_us;  // For the mean: total_latency_us / zone_changes
+} proxy_sensor_stats_t;
+
+// Slow down within 1.2 m, stop within approx. 2 feet, 3 samples of dwell at 100 Hz
+#define PROXY_SENSOR_ZONES_DEFAULT() {                                          \
+    .filter = {.median_window = 5, .ema_shift = 2, .max_range_mm = 4000, .max_dropouts = 3}, \
+    .slow = {.enter_mm = 1200, .exit_mm = 1350, .min_dwell_us = 30000},          \
+    .stop = {.enter_mm = 610, .exit_mm = 700, .min_dwell_us = 30000},            \
+}
+
+typedef struct {
+    uint8_t sensor_id;
+    proxy_zone_id_t zone;
+} proxy_sensor_channel_t;
+
 typedef struct {
-    int udp_sock;
-    struct sockaddr_in pc_addr;
+    const proxy_sensor_backend_t *backends[PROXY_SENSOR_MAX_BACKENDS];
+    uint8_t num_backends;
+    proxy_sensor_channel_t channels[PROXY_ZONE_MAX_CHANNELS];
+    uint8_t num_channels;
+    proxy_zone_config_t zones;      // e.g. PROXY_SENSOR_ZONES_DEFAULT()
 } proxy_sensor_params_t;
 
+/**
+ * @brief Sensor array task: starts every backend and fuses their samples into zone states
+ *
+ * Sends a ZONE message only when a zone changes state; changes to STOP
+ * bypass the uplink flush window.
+ *
+ * @param pvParameters proxy_sensor_params_t, must outlive the task
+ */
 void proxy_sensor_task(void *pvParameters);
 
+/**
+ * @brief Hand a sample to the sensor task from a task context
+ *
+ * @return false if the sample queue is full or the task is not running
+ */
+bool proxy_sensor_submit(const proxy_sensor_sample_t *sample);
+
+/**
+ * @brief Hand a sample to the sensor task from an ISR
+ *
+ * @param sample            Sample to queue
+ * @param higher_prio_woken Set to pdTRUE if a context switch should be requested
+ * @return false if the sample queue is full or the task is not running
+ */
+bool proxy_sensor_submit_from_isr(const proxy_sensor_sample_t *sample, BaseType_t *higher_prio_woken);
+
+/**
+ * @brief Copy the sample and latency counters
+ */
+void proxy_sensor_get_stats(proxy_sensor_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
-
-
@@ -0,0 +1,70 @@
+// proxy_sensor_replay.c
+#include "proxy_sensor_replay.h"
+#include "agv_proto.h"
+#include "esp_log.h"
+
+static const char *TAG = "proxy_replay";
+
+static void replay_task(void *arg) {
+    proxy_replay_t *replay = arg;
+    const proxy_replay_config_t *config = &replay->config;
+    // Periods shorter than a tick replay one sample per tick rather than as fast as possible
+    const TickType_t ms_ticks = pdMS_TO_TICKS(config->period_us / 1000);
+    const TickType_t period_ticks = ms_ticks > 0 ? ms_ticks : 1;
+    TickType_t last_wake = xTaskGetTickCount();
+    uint64_t timestamp_us = agv_proto_now_us();
+
+    do {
+        for (size_t i = 0; i < config->trace_len && !replay->stop; i++) {
+            const proxy_sensor_sample_t sample = {
+                .sensor_id = config->sensor_id,
+                .distance_mm = config->trace_mm[i],
+                .timestamp_us = timestamp_us,
+            };
+            timestamp_us += config->period_us;
+
+            if (config->realtime) {
+                xTaskDelayUntil(&last_wake, period_ticks);
+                if (proxy_sensor_submit(&sample)) replay->submitted++;
+                else replay->dropped++;
+            } else {
+                // Keep every sample: wait for the sensor task to make room
+                while (!proxy_sensor_submit(&sample) && !replay->stop) vTaskDelay(1);
+                replay->submitted++;
+            }
+        }
+    } while (config->loop && !replay->stop);
+
+    ESP_LOGI(TAG, "Replay finished: %u samples, %u dropped", (unsigned)replay->submitted, (unsigned)replay->dropped);
+    replay->task = NULL;
+    vTaskDelete(NULL);
+}
+
+static esp_err_t replay_start(void *ctx) {
+    proxy_replay_t *replay = ctx;
+
+    if (!replay->config.trace_mm || replay->config.trace_len == 0) return ESP_ERR_INVALID_ARG;
+    replay->stop = false;
+    if (xTaskCreate(replay_task, "proxy_replay", 2048, replay, 4, &replay->task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static void replay_stop(void *ctx) {
+    proxy_replay_t *replay = ctx;
+    replay->stop = true;
+}
+
+void proxy_replay_backend(proxy_replay_t *replay, const proxy_replay_config_t *config,
+                          proxy_sensor_backend_t *backend) {
+    *replay = (proxy_replay_t) {
+        .config = *config,
+    };
+    *backend = (proxy_sensor_backend_t) {
+        .name = "replay",
+        .start = replay_start,
+        .stop = replay_stop,
+        .ctx = replay,
+    };
+}
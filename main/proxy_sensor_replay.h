@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "proxy_sensor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const uint16_t *trace_mm;   // Recorded distances, PROXY_SENSOR_NO_ECHO for no echo
+    size_t trace_len;
+    uint8_t sensor_id;
+    uint32_t period_us;         // Sample spacing in the recording, used for timestamps
+    bool realtime;              // Pace samples at period_us (tick resolution, one tick at least) instead of as fast as possible
+    bool loop;                  // Restart at the end of the trace
+} proxy_replay_config_t;
+
+// Replays a recorded distance trace, driver-free so it also runs on the linux target
+typedef struct {
+    proxy_replay_config_t config;
+    TaskHandle_t task;
+    volatile bool stop;
+    size_t submitted;           // Samples accepted by the sensor task
+    size_t dropped;             // Samples rejected because its queue was full
+} proxy_replay_t;
+
+/**
+ * @brief Set up a replay backend for proxy_sensor_task
+ *
+ * @param replay  Backend state, must outlive the sensor task
+ * @param config  Trace to replay, the trace is not copied
+ * @param backend Filled with the backend callbacks
+ */
+void proxy_replay_backend(proxy_replay_t *replay, const proxy_replay_config_t *config,
+                          proxy_sensor_backend_t *backend);
+
+#ifdef __cplusplus
+}
+#endif
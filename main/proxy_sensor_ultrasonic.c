@@ -0,0 +1,195 @@
+// proxy_sensor_ultrasonic.c
+#include "proxy_sensor_ultrasonic.h"
+#include "agv_proto.h"
+#include "esp_rom_sys.h"
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "esp_log.h"
+
+#define TRIG_PULSE_US   10
+#define ECHO_TIMEOUT_US 40000   // Longest echo an HC-SR04 produces, with nothing in range
+
+static const char *TAG = "proxy_ultrasonic";
+
+// Echo width in capture ticks to millimetres: speed of sound 343 m/s, there and back
+static inline uint16_t ultrasonic_ticks_to_mm(uint32_t ticks, uint32_t resolution_hz) {
+    uint64_t mm = (uint64_t)ticks * 171500ULL / resolution_hz;
+    return mm > PROXY_ULTRASONIC_MAX_RANGE_MM ? PROXY_SENSOR_NO_ECHO : (uint16_t)mm;
+}
+
+static bool IRAM_ATTR ultrasonic_on_capture(mcpwm_cap_channel_handle_t cap_chan,
+                                            const mcpwm_capture_event_data_t *edata, void *user_data) {
+    proxy_ultrasonic_channel_t *chan = user_data;
+    BaseType_t higher_prio_woken = pdFALSE;
+
+    if (edata->cap_edge == MCPWM_CAP_EDGE_POS) {
+        chan->echo_start = edata->cap_value;
+        return false;
+    }
+
+    const proxy_sensor_sample_t sample = {
+        .sensor_id = chan->config->sensor_id,
+        .distance_mm = ultrasonic_ticks_to_mm(edata->cap_value - chan->echo_start, chan->sensor->resolution_hz),
+        .timestamp_us = chan->ping_us,
+    };
+    chan->echo_pending = false;
+    proxy_sensor_submit_from_isr(&sample, &higher_prio_woken);
+    return higher_prio_woken == pdTRUE;
+}
+
+static void ultrasonic_ping_channel(proxy_ultrasonic_channel_t *chan, uint64_t now) {
+    // The sensor ignores triggers until its echo line drops
+    if (chan->echo_pending && now - chan->ping_us < ECHO_TIMEOUT_US) return;
+
+    chan->echo_pending = true;
+    chan->ping_us = now;
+    gpio_set_level(chan->config->trig_gpio, 1);
+    esp_rom_delay_us(TRIG_PULSE_US);
+    gpio_set_level(chan->config->trig_gpio, 0);
+}
+
+// Runs in the esp_timer task
+static void ultrasonic_ping(void *arg) {
+    proxy_ultrasonic_t *sensor = arg;
+    const uint64_t now = agv_proto_now_us();
+
+    if (sensor->config.schedule == PROXY_ULTRASONIC_CONCURRENT) {
+        for (int i = 0; i < sensor->config.num_channels; i++) ultrasonic_ping_channel(&sensor->channels[i], now);
+    } else {
+        ultrasonic_ping_channel(&sensor->channels[sensor->next_channel], now);
+        sensor->next_channel = (sensor->next_channel + 1) % sensor->config.num_channels;
+    }
+}
+
+static esp_err_t ultrasonic_start_channel(proxy_ultrasonic_t *sensor, proxy_ultrasonic_channel_t *chan) {
+    const gpio_config_t trig_conf = {
+        .pin_bit_mask = 1ULL << chan->config->trig_gpio,
+        .mode = GPIO_MODE_OUTPUT,
+    };
+    ESP_RETURN_ON_ERROR(gpio_config(&trig_conf), TAG, "trig GPIO");
+    gpio_set_level(chan->config->trig_gpio, 0);
+
+    const mcpwm_capture_channel_config_t chan_conf = {
+        .gpio_num = chan->config->echo_gpio,
+        .prescale = 1,
+        .flags.pos_edge = true,
+        .flags.neg_edge = true,
+        .flags.pull_up = true,
+    };
+    ESP_RETURN_ON_ERROR(mcpwm_new_capture_channel(sensor->cap_timer, &chan_conf, &chan->cap_chan), TAG, "capture channel");
+
+    const mcpwm_capture_event_callbacks_t cbs = {
+        .on_cap = ultrasonic_on_capture,
+    };
+    ESP_RETURN_ON_ERROR(mcpwm_capture_channel_register_event_callbacks(chan->cap_chan, &cbs, chan), TAG, "capture callback");
+    ESP_RETURN_ON_ERROR(mcpwm_capture_channel_enable(chan->cap_chan), TAG, "capture enable");
+
+    ESP_LOGI(TAG, "Ultrasonic sensor %d: trig GPIO %d, echo GPIO %d",
+             chan->config->sensor_id, chan->config->trig_gpio, chan->config->echo_gpio);
+    return ESP_OK;
+}
+
+// Also undoes a partial start, every handle that was never created is NULL
+static void ultrasonic_release(proxy_ultrasonic_t *sensor) {
+    if (sensor->ping_timer) {
+        esp_timer_stop(sensor->ping_timer);
+        esp_timer_delete(sensor->ping_timer);
+        sensor->ping_timer = NULL;
+    }
+    if (sensor->cap_timer) {
+        mcpwm_capture_timer_stop(sensor->cap_timer);
+        mcpwm_capture_timer_disable(sensor->cap_timer);
+    }
+    for (int i = 0; i < sensor->config.num_channels; i++) {
+        proxy_ultrasonic_channel_t *chan = &sensor->channels[i];
+        if (!chan->cap_chan) continue;
+        mcpwm_capture_channel_disable(chan->cap_chan);
+        mcpwm_del_capture_channel(chan->cap_chan);
+        chan->cap_chan = NULL;
+    }
+    if (sensor->cap_timer) {
+        mcpwm_del_capture_timer(sensor->cap_timer);
+        sensor->cap_timer = NULL;
+    }
+}
+
+static esp_err_t ultrasonic_start(void *ctx) {
+    proxy_ultrasonic_t *sensor = ctx;
+    esp_err_t ret = ESP_OK;
+
+    if (sensor->config.num_channels == 0 || sensor->config.num_channels > PROXY_ULTRASONIC_MAX_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const mcpwm_capture_timer_config_t timer_conf = {
+        .clk_src = MCPWM_CAPTURE_CLK_SRC_DEFAULT,
+        .group_id = 0,
+    };
+    ESP_GOTO_ON_ERROR(mcpwm_new_capture_timer(&timer_conf, &sensor->cap_timer), fail, TAG, "capture timer");
+    ESP_GOTO_ON_ERROR(mcpwm_capture_timer_get_resolution(sensor->cap_timer, &sensor->resolution_hz), fail, TAG,
+                      "capture resolution");
+
+    for (int i = 0; i < sensor->config.num_channels; i++) {
+        ESP_GOTO_ON_ERROR(ultrasonic_start_channel(sensor, &sensor->channels[i]), fail, TAG,
+                          "sensor %d", sensor->channels[i].config->sensor_id);
+    }
+    ESP_GOTO_ON_ERROR(mcpwm_capture_timer_enable(sensor->cap_timer), fail, TAG, "capture timer enable");
+    ESP_GOTO_ON_ERROR(mcpwm_capture_timer_start(sensor->cap_timer), fail, TAG, "capture timer start");
+
+    const esp_timer_create_args_t ping_args = {
+        .callback = ultrasonic_ping,
+        .arg = sensor,
+        .name = "ultrasonic_ping",
+    };
+    ESP_GOTO_ON_ERROR(esp_timer_create(&ping_args, &sensor->ping_timer), fail, TAG, "ping timer");
+    // Start idle, the sensor task raises the rate once a zone is entered
+    sensor->active = false;
+    ESP_GOTO_ON_ERROR(esp_timer_start_periodic(sensor->ping_timer, sensor->config.idle_period_us), fail, TAG,
+                      "ping timer start");
+
+    ESP_LOGI(TAG, "%d channels, %s, ping every %lu us (%lu us idle)", sensor->config.num_channels,
+             sensor->config.schedule == PROXY_ULTRASONIC_CONCURRENT ? "concurrent" : "round robin",
+             (unsigned long)sensor->config.period_us, (unsigned long)sensor->config.idle_period_us);
+    return ESP_OK;
+
+fail:
+    ultrasonic_release(sensor);
+    return ret;
+}
+
+// Runs in the sensor task
+static void ultrasonic_set_active(void *ctx, bool active) {
+    proxy_ultrasonic_t *sensor = ctx;
+
+    // Nothing to retime if start failed
+    if (!sensor->ping_timer) return;
+    if (active == sensor->active || sensor->config.idle_period_us == sensor->config.period_us) return;
+    sensor->active = active;
+    // The next ping comes one new period from now, not at the end of the idle one
+    esp_timer_restart(sensor->ping_timer, active ? sensor->config.period_us : sensor->config.idle_period_us);
+}
+
+static void ultrasonic_stop(void *ctx) {
+    ultrasonic_release(ctx);
+}
+
+void proxy_ultrasonic_backend(proxy_ultrasonic_t *sensor, const proxy_ultrasonic_config_t *config,
+                              proxy_sensor_backend_t *backend) {
+    *sensor = (proxy_ultrasonic_t) {
+        .config = *config,
+    };
+    if (sensor->config.period_us == 0) sensor->config.period_us = PROXY_ULTRASONIC_DEFAULT_PERIOD_US;
+    if (sensor->config.idle_period_us < sensor->config.period_us) sensor->config.idle_period_us = sensor->config.period_us;
+    for (int i = 0; i < PROXY_ULTRASONIC_MAX_CHANNELS; i++) {
+        sensor->channels[i].config = &sensor->config.channels[i];
+        sensor->channels[i].sensor = sensor;
+    }
+
+    *backend = (proxy_sensor_backend_t) {
+        .name = "ultrasonic",
+        .start = ultrasonic_start,
+        .stop = ultrasonic_stop,
+        .set_active = ultrasonic_set_active,
+        .ctx = sensor,
+    };
+}
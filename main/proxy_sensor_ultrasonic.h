@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "driver/mcpwm_cap.h"
+#include "esp_timer.h"
+#include "proxy_sensor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROXY_ULTRASONIC_DEFAULT_PERIOD_US  10000   // 100 Hz, a ping is skipped while an echo is still high
+#define PROXY_ULTRASONIC_IDLE_PERIOD_US     50000   // 20 Hz while nothing is near
+#define PROXY_ULTRASONIC_MAX_RANGE_MM       4000
+#define PROXY_ULTRASONIC_MAX_CHANNELS       3       // Capture channels in one MCPWM group
+
+typedef enum {
+    PROXY_ULTRASONIC_ROUND_ROBIN = 0,   // One channel per period, no crosstalk between sensors
+    PROXY_ULTRASONIC_CONCURRENT,        // Every channel each period, for sensors that cannot hear each other
+} proxy_ultrasonic_schedule_t;
+
+typedef struct {
+    gpio_num_t trig_gpio;
+    gpio_num_t echo_gpio;
+    uint8_t sensor_id;
+} proxy_ultrasonic_channel_config_t;
+
+typedef struct {
+    proxy_ultrasonic_channel_config_t channels[PROXY_ULTRASONIC_MAX_CHANNELS];
+    uint8_t num_channels;
+    proxy_ultrasonic_schedule_t schedule;
+    uint32_t period_us;         // Ping interval, 0 = default
+    uint32_t idle_period_us;    // Ping interval while nothing is near, 0 = always period_us
+} proxy_ultrasonic_config_t;
+
+typedef struct proxy_ultrasonic proxy_ultrasonic_t;
+
+typedef struct {
+    const proxy_ultrasonic_channel_config_t *config;
+    proxy_ultrasonic_t *sensor;
+    mcpwm_cap_channel_handle_t cap_chan;
+    uint32_t echo_start;
+    volatile bool echo_pending;
+    uint64_t ping_us;
+} proxy_ultrasonic_channel_t;
+
+// HC-SR04 style sensors: trigger pulses from esp_timer, echo widths from MCPWM capture
+struct proxy_ultrasonic {
+    proxy_ultrasonic_config_t config;
+    mcpwm_cap_timer_handle_t cap_timer;
+    esp_timer_handle_t ping_timer;
+    uint32_t resolution_hz;
+    uint8_t next_channel;       // Round robin position
+    bool active;                // Pinging at period_us rather than idle_period_us
+    proxy_ultrasonic_channel_t channels[PROXY_ULTRASONIC_MAX_CHANNELS];
+};
+
+/**
+ * @brief Set up a backend for proxy_sensor_task, the hardware is claimed on start
+ *
+ * @param sensor  Backend state, must outlive the sensor task
+ * @param config  Channels, schedule and ping rate
+ * @param backend Filled with the backend callbacks
+ */
+void proxy_ultrasonic_backend(proxy_ultrasonic_t *sensor, const proxy_ultrasonic_config_t *config,
+                              proxy_sensor_backend_t *backend);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,88 @@
+// proxy_zone.c
+#include <string.h>
+#include "proxy_zone.h"
+
+static proxy_zone_state_t zone_worst_state(const proxy_zone_fusion_t *fusion, proxy_zone_id_t zone) {
+    for (int state = PROXY_ZONE_STATE_COUNT - 1; state > PROXY_ZONE_CLEAR; state--) {
+        if (fusion->state_count[zone][state]) return (proxy_zone_state_t)state;
+    }
+    return PROXY_ZONE_CLEAR;
+}
+
+static void channel_set_near(proxy_zone_fusion_t *fusion, proxy_zone_channel_t *chan, bool near) {
+    if (near == chan->near) return;
+    chan->near = near;
+    if (near) fusion->near_count++;
+    else fusion->near_count--;
+}
+
+void proxy_zone_init(proxy_zone_fusion_t *fusion, const proxy_zone_config_t *config) {
+    memset(fusion, 0, sizeof(*fusion));
+    fusion->config = *config;
+}
+
+bool proxy_zone_add_channel(proxy_zone_fusion_t *fusion, uint8_t sensor_id, proxy_zone_id_t zone) {
+    if (sensor_id >= PROXY_ZONE_MAX_CHANNELS || zone >= PROXY_ZONE_COUNT) return false;
+
+    proxy_zone_channel_t *chan = &fusion->channels[sensor_id];
+    if (chan->used) {
+        fusion->state_count[chan->zone][chan->state]--;
+        channel_set_near(fusion, chan, false);
+    }
+
+    memset(chan, 0, sizeof(*chan));
+    proxy_filter_init(&chan->filter, &fusion->config.filter);
+    chan->zone = zone;
+    chan->state = PROXY_ZONE_CLEAR;
+    chan->used = true;
+    fusion->state_count[zone][PROXY_ZONE_CLEAR]++;
+    return true;
+}
+
+bool proxy_zone_update(proxy_zone_fusion_t *fusion, uint8_t sensor_id, uint16_t distance_mm,
+                       uint64_t timestamp_us, proxy_zone_change_t *change) {
+    if (sensor_id >= PROXY_ZONE_MAX_CHANNELS || !fusion->channels[sensor_id].used) return false;
+    proxy_zone_channel_t *chan = &fusion->channels[sensor_id];
+
+    // One raw echo is enough to speed up sampling, the filter decides the state
+    const bool close = distance_mm <= fusion->config.filter.max_range_mm && distance_mm < fusion->config.slow.exit_mm;
+    if (close) channel_set_near(fusion, chan, true);
+
+    if (!proxy_filter_smooth(&chan->filter, distance_mm)) return false;
+    const uint16_t filtered = chan->filter.filtered_mm;
+    channel_set_near(fusion, chan, close || filtered < fusion->config.slow.exit_mm);
+    proxy_threshold_update(&chan->slow, &fusion->config.slow, filtered, timestamp_us);
+    proxy_threshold_update(&chan->stop, &fusion->config.stop, filtered, timestamp_us);
+
+    const proxy_zone_state_t state = chan->stop.triggered ? PROXY_ZONE_STOP
+                                     : chan->slow.triggered ? PROXY_ZONE_SLOW : PROXY_ZONE_CLEAR;
+    if (state == chan->state) return false;
+
+    fusion->state_count[chan->zone][chan->state]--;
+    fusion->state_count[chan->zone][state]++;
+    chan->state = state;
+
+    const proxy_zone_state_t prev = fusion->zone_state[chan->zone];
+    const proxy_zone_state_t next = zone_worst_state(fusion, chan->zone);
+    if (next == prev) return false;
+
+    fusion->zone_state[chan->zone] = next;
+    if (change) {
+        *change = (proxy_zone_change_t) {
+            .zone = chan->zone,
+            .state = next,
+            .prev_state = prev,
+            .sensor_id = sensor_id,
+            .distance_mm = filtered,
+        };
+    }
+    return true;
+}
+
+bool proxy_zone_active(const proxy_zone_fusion_t *fusion) {
+    if (fusion->near_count) return true;
+    for (int zone = 0; zone < PROXY_ZONE_COUNT; zone++) {
+        if (fusion->zone_state[zone] != PROXY_ZONE_CLEAR) return true;
+    }
+    return false;
+}
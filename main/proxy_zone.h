@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "proxy_filter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROXY_ZONE_MAX_CHANNELS 8
+
+typedef enum {
+    PROXY_ZONE_FRONT = 0,
+    PROXY_ZONE_REAR,
+    PROXY_ZONE_LEFT,
+    PROXY_ZONE_RIGHT,
+    PROXY_ZONE_COUNT
+} proxy_zone_id_t;
+
+// Ordered by severity, a zone takes the worst state of its channels
+typedef enum {
+    PROXY_ZONE_CLEAR = 0,
+    PROXY_ZONE_SLOW,
+    PROXY_ZONE_STOP,
+    PROXY_ZONE_STATE_COUNT
+} proxy_zone_state_t;
+
+typedef struct {
+    proxy_filter_config_t filter;       // Smoothing per channel, its thresholds are not used
+    proxy_threshold_config_t slow;
+    proxy_threshold_config_t stop;      // Closer than slow
+} proxy_zone_config_t;
+
+typedef struct {
+    proxy_zone_id_t zone;
+    proxy_zone_state_t state;
+    proxy_zone_state_t prev_state;
+    uint8_t sensor_id;                  // Channel that caused the change
+    uint16_t distance_mm;               // Its smoothed distance
+} proxy_zone_change_t;
+
+typedef struct {
+    proxy_filter_t filter;
+    proxy_threshold_t slow;
+    proxy_threshold_t stop;
+    proxy_zone_id_t zone;
+    proxy_zone_state_t state;
+    bool near;                          // Last echo or smoothed distance inside slow.exit_mm
+    bool used;
+} proxy_zone_channel_t;
+
+// Fusion state. Channels are indexed by sensor_id and each zone keeps a count of
+// its channels per state, so one sample costs the same whatever the channel count.
+typedef struct {
+    proxy_zone_config_t config;
+    proxy_zone_channel_t channels[PROXY_ZONE_MAX_CHANNELS];
+    uint8_t state_count[PROXY_ZONE_COUNT][PROXY_ZONE_STATE_COUNT];
+    proxy_zone_state_t zone_state[PROXY_ZONE_COUNT];
+    uint8_t near_count;                 // Channels with near set
+} proxy_zone_fusion_t;
+
+/**
+ * @brief Reset the fusion state, all zones clear and no channels
+ */
+void proxy_zone_init(proxy_zone_fusion_t *fusion, const proxy_zone_config_t *config);
+
+/**
+ * @brief Assign a sensor to a zone
+ *
+ * @return false if sensor_id is out of range or zone is invalid
+ */
+bool proxy_zone_add_channel(proxy_zone_fusion_t *fusion, uint8_t sensor_id, proxy_zone_id_t zone);
+
+/**
+ * @brief Feed one raw sample from a channel
+ *
+ * @param fusion       Fusion state
+ * @param sensor_id    Channel added with proxy_zone_add_channel()
+ * @param distance_mm  Raw distance, anything above the filter max_range_mm for no echo
+ * @param timestamp_us Sample time, monotonic per channel
+ * @param change       Filled when the channel's zone changes state
+ * @return true if the zone state changed
+ */
+bool proxy_zone_update(proxy_zone_fusion_t *fusion, uint8_t sensor_id, uint16_t distance_mm,
+                       uint64_t timestamp_us, proxy_zone_change_t *change);
+
+/**
+ * @brief Whether anything is close enough that the sensors should sample at full rate
+ *
+ * True from the first in-range echo inside slow.exit_mm, before the filter has
+ * confirmed it, until every channel reads beyond slow.exit_mm and every zone is clear.
+ */
+bool proxy_zone_active(const proxy_zone_fusion_t *fusion);
+
+#ifdef __cplusplus
+}
+#endif
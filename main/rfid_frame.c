@@ -0,0 +1,82 @@
+// rfid_frame.c
+#include <string.h>
+#include "rfid_frame.h"
+
+#define KEYBOARD_ENTER_MAIN_CHAR '\r'
+
+#define KEY_BIT_WORD(key)   ((key) >> 5)
+#define KEY_BIT_MASK(key)   (1u << ((key) & 31))
+
+// Keycode to ASCII lookup, indexed [shift][key_code] for every 8-bit keycode.
+// Keycodes without a printable character (including the reserved 0x00-0x03) map to 0.
+#define KEY(code, lower, upper) [0][code] = (lower), [1][code] = (upper)
+static const uint8_t keycode_lut[2][256] = {
+    KEY(HID_KEY_A, 'a', 'A'), KEY(HID_KEY_B, 'b', 'B'), KEY(HID_KEY_C, 'c', 'C'),
+    KEY(HID_KEY_D, 'd', 'D'), KEY(HID_KEY_E, 'e', 'E'), KEY(HID_KEY_F, 'f', 'F'),
+    KEY(HID_KEY_G, 'g', 'G'), KEY(HID_KEY_H, 'h', 'H'), KEY(HID_KEY_I, 'i', 'I'),
+    KEY(HID_KEY_J, 'j', 'J'), KEY(HID_KEY_K, 'k', 'K'), KEY(HID_KEY_L, 'l', 'L'),
+    KEY(HID_KEY_M, 'm', 'M'), KEY(HID_KEY_N, 'n', 'N'), KEY(HID_KEY_O, 'o', 'O'),
+    KEY(HID_KEY_P, 'p', 'P'), KEY(HID_KEY_Q, 'q', 'Q'), KEY(HID_KEY_R, 'r', 'R'),
+    KEY(HID_KEY_S, 's', 'S'), KEY(HID_KEY_T, 't', 'T'), KEY(HID_KEY_U, 'u', 'U'),
+    KEY(HID_KEY_V, 'v', 'V'), KEY(HID_KEY_W, 'w', 'W'), KEY(HID_KEY_X, 'x', 'X'),
+    KEY(HID_KEY_Y, 'y', 'Y'), KEY(HID_KEY_Z, 'z', 'Z'),
+    KEY(HID_KEY_1, '1', '!'), KEY(HID_KEY_2, '2', '@'), KEY(HID_KEY_3, '3', '#'),
+    KEY(HID_KEY_4, '4', '$'), KEY(HID_KEY_5, '5', '%'), KEY(HID_KEY_6, '6', '^'),
+    KEY(HID_KEY_7, '7', '&'), KEY(HID_KEY_8, '8', '*'), KEY(HID_KEY_9, '9', '('),
+    KEY(HID_KEY_0, '0', ')'),
+    KEY(HID_KEY_ENTER, KEYBOARD_ENTER_MAIN_CHAR, KEYBOARD_ENTER_MAIN_CHAR),
+    KEY(HID_KEY_DEL, '\b', 0),
+    KEY(HID_KEY_SPACE, ' ', ' '), KEY(HID_KEY_MINUS, '-', '_'), KEY(HID_KEY_EQUAL, '=', '+'),
+    KEY(HID_KEY_OPEN_BRACKET, '[', '{'), KEY(HID_KEY_CLOSE_BRACKET, ']', '}'),
+    KEY(HID_KEY_BACK_SLASH, '\\', '|'), KEY(HID_KEY_SHARP, '\\', '|'),
+    KEY(HID_KEY_COLON, ';', ':'), KEY(HID_KEY_QUOTE, '\'', '\"'), KEY(HID_KEY_TILDE, '`', '~'),
+    KEY(HID_KEY_LESS, ',', '<'), KEY(HID_KEY_GREATER, '.', '>'), KEY(HID_KEY_SLASH, '/', '?'),
+};
+#undef KEY
+
+static void rfid_frame_complete(rfid_frame_t *frame) {
+    if (frame->len > 0) {
+        frame->buffer[frame->len] = '\0';
+        if (frame->on_tag) frame->on_tag(frame->buffer, frame->len, frame->on_tag_arg);
+    }
+    frame->len = 0;
+}
+
+void rfid_frame_init(rfid_frame_t *frame, rfid_frame_cb_t on_tag, void *arg) {
+    memset(frame, 0, sizeof(*frame));
+    frame->on_tag = on_tag;
+    frame->on_tag_arg = arg;
+}
+
+void rfid_frame_feed_report(rfid_frame_t *frame, const uint8_t *data, size_t length) {
+    const hid_keyboard_input_report_boot_t *kb_report = (const hid_keyboard_input_report_boot_t *)data;
+    if (length < sizeof(hid_keyboard_input_report_boot_t)) return;
+
+    const int shift = (kb_report->modifier.val & (HID_LEFT_SHIFT | HID_RIGHT_SHIFT)) ? 1 : 0;
+
+    // Local copies: character stores into frame->buffer must not force reloads of the report
+    uint8_t keys[HID_KEYBOARD_KEY_MAX];
+    memcpy(keys, kb_report->key, sizeof(keys));
+
+    // A key is a new press when its bit is clear in the bitmap of the previous report
+    // (current XOR previous, restricted to keys present now).
+    // Releases need no handling, reserved keycodes decode to 0.
+    for (int i = 0; i < HID_KEYBOARD_KEY_MAX; i++) {
+        const uint8_t key_char = keycode_lut[shift][keys[i]];
+        if (!key_char || (frame->pressed[KEY_BIT_WORD(keys[i])] & KEY_BIT_MASK(keys[i]))) continue;
+
+        if (KEYBOARD_ENTER_MAIN_CHAR == key_char) {
+            rfid_frame_complete(frame);
+        } else if (frame->len < RFID_BUFFER_SIZE - 1) {
+            frame->buffer[frame->len++] = key_char;
+        } else {
+            frame->dropped_chars++;
+        }
+    }
+
+    // Rebuild the 256-bit bitmap for the next report in a local copy: at most six words
+    // change, and 32-bit words are single loads and stores on the 32-bit core.
+    uint32_t next[RFID_KEY_BITMAP_WORDS] = {0};
+    for (int i = 0; i < HID_KEYBOARD_KEY_MAX; i++) next[KEY_BIT_WORD(keys[i])] |= KEY_BIT_MASK(keys[i]);
+    memcpy(frame->pressed, next, sizeof(next));
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "usb/hid_usage_keyboard.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RFID_BUFFER_SIZE 64
+#define RFID_KEY_BITMAP_WORDS (256 / 32)    // 32-bit words, native on the Xtensa core
+
+/**
+ * @brief Called once per completed tag (Enter received)
+ *
+ * @param tag Null-terminated tag characters, valid only during the call
+ * @param len Number of characters in tag
+ * @param arg User argument given to rfid_frame_init()
+ */
+typedef void (*rfid_frame_cb_t)(const char *tag, size_t len, void *arg);
+
+// RFID frame assembler state, one per keyboard-emulating reader
+typedef struct {
+    char buffer[RFID_BUFFER_SIZE];
+    size_t len;
+    uint32_t pressed[RFID_KEY_BITMAP_WORDS];  // Bitmap of keycodes held in the previous report
+    uint32_t dropped_chars;       // Characters discarded because the buffer was full
+    rfid_frame_cb_t on_tag;
+    void *on_tag_arg;
+} rfid_frame_t;
+
+/**
+ * @brief Reset an assembler and set its completed-tag callback
+ */
+void rfid_frame_init(rfid_frame_t *frame, rfid_frame_cb_t on_tag, void *arg);
+
+/**
+ * @brief Consume one boot-protocol keyboard report
+ *
+ * Newly pressed keys are decoded and appended to the frame without any console I/O.
+ * On Enter the callback is invoked once with the whole tag.
+ *
+ * @param frame  Assembler state
+ * @param data   Raw report data (at least sizeof(hid_keyboard_input_report_boot_t))
+ * @param length Report length in bytes
+ */
+void rfid_frame_feed_report(rfid_frame_t *frame, const uint8_t *data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
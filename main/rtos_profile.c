@@ -0,0 +1,172 @@
+// rtos_profile.c
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "udp_uplink.h"
+#include "rtos_profile.h"
+
+static const char *TAG = "rtos_profile";
+
+static rtos_profile_stats_t stats;
+static uint32_t queue_max;      // Since the last report, raised by the senders
+static bool paused = true;      // Link down, see rtos_profile_set_paused()
+
+#if configUSE_TRACE_FACILITY
+static rtos_profile_config_t profile_config;
+static TaskHandle_t profile_task_handle;
+static TaskHandle_t stop_waiter;
+static volatile bool stop_requested;
+
+// Profiler task only. Run time counters wrap after 71 minutes, so shares come from
+// unsigned differences, matched by task number since a handle can be reused.
+static TaskStatus_t status[RTOS_PROFILE_MAX_TASKS];
+static UBaseType_t prev_number[RTOS_PROFILE_MAX_TASKS];
+static uint32_t prev_run_time[RTOS_PROFILE_MAX_TASKS];
+static UBaseType_t prev_count;
+static uint32_t prev_total;
+
+static uint16_t rtos_profile_cpu(const TaskStatus_t *task, uint32_t period_us) {
+#if configGENERATE_RUN_TIME_STATS
+    // A task started during the period has run for all of its counter
+    uint32_t run_us = (uint32_t)task->ulRunTimeCounter;
+    for (UBaseType_t i = 0; i < prev_count; i++) {
+        if (prev_number[i] == task->xTaskNumber) {
+            run_us -= prev_run_time[i];
+            break;
+        }
+    }
+    if (!period_us) return 0;
+    const uint64_t permille = (uint64_t)run_us * 1000 / period_us;
+    return permille < 1000 ? (uint16_t)permille : 1000;
+#else
+    return AGV_TASK_CPU_UNKNOWN;
+#endif
+}
+
+static void rtos_profile_report(void) {
+    static agv_msg_task_t tasks[RTOS_PROFILE_MAX_TASKS];
+    configRUN_TIME_COUNTER_TYPE total = 0;
+
+    // Fails as a whole when the array is too small, rather than leaving tasks out
+    const UBaseType_t count = uxTaskGetSystemState(status, RTOS_PROFILE_MAX_TASKS, &total);
+    if (count == 0) {
+        stats.overflows++;
+        ESP_LOGW(TAG, "More than %d tasks, no report", RTOS_PROFILE_MAX_TASKS);
+        return;
+    }
+    const uint32_t period_us = (uint32_t)total - prev_total;
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t *task = &status[i];
+        const BaseType_t core = xTaskGetCoreID(task->xHandle);
+        agv_msg_task_t *msg = &tasks[i];
+        memset(msg, 0, sizeof(*msg));
+        // Not null-terminated on the wire when the name fills the field
+        memcpy(msg->name, task->pcTaskName, strnlen(task->pcTaskName, sizeof(msg->name)));
+        msg->core = core == tskNO_AFFINITY ? AGV_TASK_CORE_ANY : (uint8_t)core;
+        msg->priority = (uint8_t)task->uxCurrentPriority;
+        msg->state = (uint8_t)task->eCurrentState;
+        msg->cpu_permille = rtos_profile_cpu(task, period_us);
+        msg->stack_free_min = task->usStackHighWaterMark < UINT16_MAX ? task->usStackHighWaterMark : UINT16_MAX;
+    }
+    for (UBaseType_t i = 0; i < count; i++) {
+        prev_number[i] = status[i].xTaskNumber;
+        prev_run_time[i] = (uint32_t)status[i].ulRunTimeCounter;
+    }
+    prev_count = count;
+    prev_total = (uint32_t)total;
+
+    agv_msg_profile_t profile = {
+        .period_us = period_us,
+        .heap_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+        .heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+        .heap_largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+        .task_count = (uint8_t)count,
+    };
+    const uint32_t max = __atomic_exchange_n(&queue_max, 0, __ATOMIC_RELAXED);
+    if (profile_config.queue) {
+        const UBaseType_t waiting = uxQueueMessagesWaiting(profile_config.queue);
+        profile.queue_len = (uint8_t)(waiting + uxQueueSpacesAvailable(profile_config.queue));
+        profile.queue_waiting = (uint8_t)waiting;
+        profile.queue_max = (uint8_t)(max > waiting ? max : waiting);
+    }
+
+    // Sampled all the same, so the first report after an outage covers one period.
+    // Stored reports would only push older tags and zones out of the offline store.
+    if (__atomic_load_n(&paused, __ATOMIC_RELAXED)) return;
+
+    // Normal priority and a flush, as for metrics: the report leaves in as few datagrams as it fits
+    esp_err_t err = udp_uplink_post(AGV_MSG_PROFILE, &profile, sizeof(profile), UDP_UPLINK_PRIO_NORMAL);
+    for (UBaseType_t i = 0; i < count && err == ESP_OK; i++) {
+        err = udp_uplink_post(AGV_MSG_TASK, &tasks[i], sizeof(tasks[i]), UDP_UPLINK_PRIO_NORMAL);
+    }
+    udp_uplink_flush();
+    if (err != ESP_OK) {
+        stats.send_errors++;
+        ESP_LOGW(TAG, "Report failed: %s", esp_err_to_name(err));
+        return;
+    }
+    stats.reports++;
+}
+
+static void rtos_profile_task(void *arg) {
+    while (!stop_requested) {
+        // rtos_profile_deinit() cuts the wait short
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(profile_config.period_ms));
+        if (stop_requested) break;
+        rtos_profile_report();
+    }
+    xTaskNotifyGive(stop_waiter);
+    vTaskDelete(NULL);
+}
+#endif
+
+esp_err_t rtos_profile_init(const rtos_profile_config_t *config) {
+#if configUSE_TRACE_FACILITY
+    if (profile_task_handle) return ESP_ERR_INVALID_STATE;
+    if (config) profile_config = *config;
+    if (profile_config.period_ms == 0) profile_config.period_ms = RTOS_PROFILE_DEFAULT_PERIOD_MS;
+    stop_requested = false;
+    if (xTaskCreate(rtos_profile_task, "rtos_profile", RTOS_PROFILE_TASK_STACK, NULL, RTOS_PROFILE_TASK_PRIORITY,
+                    &profile_task_handle) != pdPASS) {
+        profile_task_handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Report every %u ms, %s", (unsigned)profile_config.period_ms,
+             configGENERATE_RUN_TIME_STATS ? "with CPU shares" : "no CPU shares without run time stats");
+    return ESP_OK;
+#else
+    ESP_LOGE(TAG, "Needs CONFIG_FREERTOS_USE_TRACE_FACILITY");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void rtos_profile_deinit(void) {
+#if configUSE_TRACE_FACILITY
+    if (!profile_task_handle) return;
+    stop_waiter = xTaskGetCurrentTaskHandle();
+    stop_requested = true;
+    xTaskNotifyGive(profile_task_handle);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    profile_task_handle = NULL;
+#endif
+}
+
+void rtos_profile_queue_depth(uint32_t waiting) {
+    uint32_t max = __atomic_load_n(&queue_max, __ATOMIC_RELAXED);
+    while (waiting > max && !__atomic_compare_exchange_n(&queue_max, &max, waiting, true,
+                                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void rtos_profile_set_paused(bool pause) {
+    __atomic_store_n(&paused, pause, __ATOMIC_RELAXED);
+}
+
+void rtos_profile_get_stats(rtos_profile_stats_t *out) {
+    if (!out) return;
+    *out = stats;
+}
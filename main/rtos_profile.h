@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+#include "agv_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTOS_PROFILE_DEFAULT_PERIOD_MS  10000
+#define RTOS_PROFILE_MAX_TASKS          32          // uxTaskGetSystemState() reports nothing beyond this
+#define RTOS_PROFILE_TASK_STACK         3072
+#define RTOS_PROFILE_TASK_PRIORITY      1           // Only ever runs when everything else is idle
+
+typedef struct {
+    uint32_t period_ms;         // Between reports, 0 = default
+    QueueHandle_t queue;        // Queue whose occupancy is reported, NULL for none
+} rtos_profile_config_t;
+
+typedef struct {
+    uint32_t reports;
+    uint32_t overflows;         // Samples skipped, more than RTOS_PROFILE_MAX_TASKS tasks
+    uint32_t send_errors;
+} rtos_profile_stats_t;
+
+/**
+ * @brief Start the profiler task, udp_uplink_init() must have been called
+ *
+ * Every period it reads uxTaskGetSystemState() and sends one AGV_MSG_PROFILE with
+ * the internal heap free, low-water and largest block and the watched queue's depth,
+ * then one AGV_MSG_TASK per task with its CPU share over the period, stack low-water
+ * mark, core and priority. The queue's maximum depth comes from its senders, which
+ * report it with rtos_profile_queue_depth().
+ *
+ * Needs CONFIG_FREERTOS_USE_TRACE_FACILITY. CPU shares also need
+ * CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS, they are AGV_TASK_CPU_UNKNOWN without it.
+ *
+ * @param config NULL for the defaults
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if already started, ESP_ERR_NOT_SUPPORTED
+ *         without the trace facility, or ESP_ERR_NO_MEM
+ */
+esp_err_t rtos_profile_init(const rtos_profile_config_t *config);
+
+/**
+ * @brief Stop the profiler task, call before deleting the watched queue
+ */
+void rtos_profile_deinit(void);
+
+/**
+ * @brief Record the watched queue's depth, called by its senders after each send
+ *
+ * Lock-free and safe from ISRs; the largest depth since the last report is sent.
+ *
+ * @param waiting uxQueueMessagesWaiting() or its FromISR variant
+ */
+void rtos_profile_queue_depth(uint32_t waiting);
+
+/**
+ * @brief Skip the reports while the link is down
+ *
+ * Tasks are still sampled every period. Starts paused.
+ */
+void rtos_profile_set_paused(bool paused);
+
+/**
+ * @brief Read the profiler's own counters
+ */
+void rtos_profile_get_stats(rtos_profile_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,60 @@
+// tag_dedup.c
+#include <string.h>
+#include "tag_dedup.h"
+
+static uint64_t tag_dedup_hash(const char *tag, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)tag[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash ? hash : 1;     // 0 marks an unused slot
+}
+
+// Single writer, but other tasks read the counters through tag_dedup_get_stats()
+static inline void tag_dedup_count(uint32_t *counter) {
+    __atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+void tag_dedup_init(tag_dedup_t *dedup, uint32_t window_us) {
+    memset(dedup, 0, sizeof(*dedup));
+    dedup->window_us = window_us ? window_us : TAG_DEDUP_DEFAULT_WINDOW_US;
+}
+
+bool tag_dedup_check(tag_dedup_t *dedup, const char *tag, size_t len, uint64_t now_us) {
+    const uint64_t hash = tag_dedup_hash(tag, len);
+    tag_dedup_entry_t *victim = NULL;
+
+    // Slots are never emptied, so an unused slot ends the run: the tag is not further on
+    for (int probe = 0; probe < TAG_DEDUP_MAX_PROBE; probe++) {
+        tag_dedup_entry_t *entry = &dedup->entries[(hash + probe) & (TAG_DEDUP_CAPACITY - 1)];
+        if (entry->hash == 0) {
+            victim = entry;
+            break;
+        }
+        const bool expired = now_us - entry->last_seen_us >= dedup->window_us;
+        if (entry->hash == hash) {
+            entry->last_seen_us = now_us;
+            if (expired) {
+                tag_dedup_count(&dedup->stats.forwarded);
+                return true;
+            }
+            tag_dedup_count(&dedup->stats.suppressed);
+            return false;
+        }
+        // The oldest slot in the run is the one most likely to have expired
+        if (!victim || entry->last_seen_us < victim->last_seen_us) victim = entry;
+    }
+
+    if (victim->hash != 0 && now_us - victim->last_seen_us < dedup->window_us) tag_dedup_count(&dedup->stats.evicted);
+    victim->hash = hash;
+    victim->last_seen_us = now_us;
+    tag_dedup_count(&dedup->stats.forwarded);
+    return true;
+}
+
+void tag_dedup_get_stats(const tag_dedup_t *dedup, tag_dedup_stats_t *stats) {
+    stats->forwarded = __atomic_load_n(&dedup->stats.forwarded, __ATOMIC_RELAXED);
+    stats->suppressed = __atomic_load_n(&dedup->stats.suppressed, __ATOMIC_RELAXED);
+    stats->evicted = __atomic_load_n(&dedup->stats.evicted, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TAG_DEDUP_CAPACITY          64      // Power of two
+#define TAG_DEDUP_MAX_PROBE         8       // Slots searched per tag before evicting the oldest
+#define TAG_DEDUP_DEFAULT_WINDOW_US 2000000
+
+typedef struct {
+    uint64_t hash;              // FNV-1a of the tag, 0 = slot never used
+    uint64_t last_seen_us;
+} tag_dedup_entry_t;
+
+typedef struct {
+    uint32_t forwarded;         // Reads that were new or outside the window
+    uint32_t suppressed;        // Repeats within the window
+    uint32_t evicted;           // Live entries overwritten because their probe run was full
+} tag_dedup_stats_t;
+
+// Open addressing set of recently read tags. Only 64-bit hashes are kept, and
+// every read is a bounded linear probe, so the cost does not grow with traffic.
+typedef struct {
+    uint32_t window_us;
+    tag_dedup_entry_t entries[TAG_DEDUP_CAPACITY];
+    tag_dedup_stats_t stats;
+} tag_dedup_t;
+
+/**
+ * @brief Empty the set
+ *
+ * @param dedup     Set state
+ * @param window_us Repeats closer together than this are suppressed, 0 = default
+ */
+void tag_dedup_init(tag_dedup_t *dedup, uint32_t window_us);
+
+/**
+ * @brief Record a read and decide whether to forward it
+ *
+ * Every read refreshes the tag's timestamp, so a tag read continuously is
+ * forwarded once and again only after a gap of at least the window.
+ *
+ * @param dedup  Set state
+ * @param tag    Tag characters
+ * @param len    Number of characters in tag
+ * @param now_us Read time, monotonic
+ * @return true if the read should be forwarded
+ */
+bool tag_dedup_check(tag_dedup_t *dedup, const char *tag, size_t len, uint64_t now_us);
+
+/**
+ * @brief Copy the counters, safe from another task than the one calling tag_dedup_check()
+ *
+ * Each counter is read atomically; the three are not one snapshot.
+ */
+void tag_dedup_get_stats(const tag_dedup_t *dedup, tag_dedup_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
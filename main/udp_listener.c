@@ -1,62 +1,131 @@
 #include <string.h>
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "esp_log.h"
-#include "lwip/sockets.h"
-#include "driver/gpio.h"
+#include "agv_proto.h"
+#include "actuator.h"
+#include "udp_reliable.h"
+#include "clock_sync.h"
+#include "metrics.h"
+#include "udp_listener.h"
 
-// Change this to your board's embedded LED GPIO
-#define GREEN_LED_PIN 13
-#define UDP_PORT 8888
-#define BUFFER_SIZE 128
-
-extern int udp_sock;             // Use your global socket from main
-extern struct sockaddr_in pc_addr; // Use your global pc_addr from main
+#define COMMAND_QUEUE_LEN 8
 
 static const char *TAG = "UDP_LISTENER";
 
-void udp_listener_task(void *pvParameters)
+typedef struct {
+    agv_msg_command_t cmd;
+    uint64_t received_us;       // agv_proto_now_us() in the transport task
+} listener_command_t;
+
+// Commands parsed by the transport task, executed here so it never touches an actuator
+static QueueHandle_t command_queue;
+
+// Stamps of the datagram being parsed
+typedef struct {
+    uint64_t server_tx_us;      // Server time the reply left
+    uint64_t rx_us;             // agv_proto_now_us() when it arrived
+} listener_rx_t;
+
+// Runs in the udp_service transport task
+static void udp_listener_queue_msg(const agv_proto_msg_hdr_t *hdr, const void *payload, void *arg)
+{
+    const listener_rx_t *rx = arg;
+    if (hdr->type == AGV_MSG_ACK) {
+        agv_msg_ack_t ack;
+        memcpy(&ack, payload, sizeof(ack));
+        udp_reliable_on_ack(&ack, rx->server_tx_us);
+        return;
+    }
+    if (hdr->type == AGV_MSG_TIME_RESP) {
+        agv_msg_time_resp_t resp;
+        memcpy(&resp, payload, sizeof(resp));
+        clock_sync_on_response(&resp, rx->server_tx_us, rx->rx_us);
+        return;
+    }
+    if (hdr->type != AGV_MSG_COMMAND) {
+        ESP_LOGW(TAG, "Ignoring message type %d", hdr->type);
+        return;
+    }
+
+    listener_command_t item = {.received_us = agv_proto_now_us()};
+    memcpy(&item.cmd, payload, sizeof(item.cmd));
+    metrics_inc(METRIC_COMMANDS);
+    if (!command_queue || xQueueSend(command_queue, &item, 0) != pdTRUE) {
+        metrics_inc(METRIC_COMMANDS_DROPPED);
+        ESP_LOGW(TAG, "Command queue full, dropping command %d", item.cmd.command);
+    }
+}
+
+void udp_listener_on_datagram(const uint8_t *data, size_t len, void *arg)
 {
-    // Initialize onboard LED as output
-    gpio_config_t io_conf = {
-        .pin_bit_mask = 1ULL << GREEN_LED_PIN,
-        .mode = GPIO_MODE_OUTPUT,
-        .pull_up_en = GPIO_PULLUP_DISABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE,
+    const listener_rx_t rx = {
+        .rx_us = agv_proto_now_us(),
+        .server_tx_us = agv_proto_dgram_tx_us(data, len),
     };
-    gpio_config(&io_conf);
+    if (agv_proto_parse(data, len, udp_listener_queue_msg, (void *)&rx) < 0) {
+        ESP_LOGW(TAG, "Dropping invalid datagram of %d bytes", (int)len);
+    }
+}
 
-    char buffer[BUFFER_SIZE];
+// Schedules the command on the actuator timers and returns immediately
+static void udp_listener_execute(const listener_command_t *item)
+{
+    const agv_msg_command_t *cmd = &item->cmd;
+    esp_err_t err;
 
-    while (1)
-    {
-        if (udp_sock < 0) {
-            ESP_LOGW(TAG, "UDP socket not ready, waiting...");
-            vTaskDelay(pdMS_TO_TICKS(500));
-            continue;
+    switch (cmd->command) {
+    case AGV_CMD_LED_GREEN_ON:
+        err = actuator_set(ACTUATOR_LED_GREEN, 1, cmd->duration_ms, item->received_us);
+        break;
+    case AGV_CMD_LED_GREEN_OFF:
+        err = actuator_set(ACTUATOR_LED_GREEN, 0, 0, item->received_us);
+        break;
+    case AGV_CMD_LED_GREEN_BLINK: {
+        if (cmd->arg == 0 || cmd->duration_ms == 0) {
+            ESP_LOGW(TAG, "Ignoring empty blink command");
+            return;
         }
+        const actuator_step_t blink[] = {
+            {.level = 1, .duration_ms = cmd->duration_ms},
+            {.level = 0, .duration_ms = cmd->duration_ms},
+        };
+        err = actuator_play(ACTUATOR_LED_GREEN, blink, 2, cmd->arg - 1, item->received_us);
+        break;
+    }
+    default:
+        ESP_LOGW(TAG, "Unknown command %d", cmd->command);
+        return;
+    }
 
-        struct sockaddr_in sender_addr;
-        socklen_t addr_len = sizeof(sender_addr);
-        int len = recvfrom(udp_sock, buffer, BUFFER_SIZE - 1, 0,
-                           (struct sockaddr *)&sender_addr, &addr_len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Command %d failed: %s", cmd->command, esp_err_to_name(err));
+        return;
+    }
+    actuator_stats_t stats;
+    actuator_get_stats(ACTUATOR_LED_GREEN, &stats);
+    ESP_LOGI(TAG, "Command %d (%d ms) actuated in %" PRIu32 " us (max %" PRIu32 " us)",
+             cmd->command, cmd->duration_ms, stats.last_latency_us, stats.max_latency_us);
+}
 
-        if (len < 0) {
-            ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
-            vTaskDelay(pdMS_TO_TICKS(500));
-            continue;
-        }
+void udp_listener_task(void *pvParameters)
+{
+    ESP_ERROR_CHECK(actuator_init());
 
-        buffer[len] = '\0'; // Null-terminate the string
-        ESP_LOGI(TAG, "Received UDP message: %s", buffer);
+    command_queue = xQueueCreate(COMMAND_QUEUE_LEN, sizeof(listener_command_t));
+    if (!command_queue) {
+        ESP_LOGE(TAG, "Failed to create command queue");
+        vTaskDelete(NULL);
+    }
 
-        if (strcmp(buffer, "LED_GREEN_ON") == 0) {
-            ESP_LOGI(TAG, "Turning onboard LED ON for 2 seconds");
-            gpio_set_level(GREEN_LED_PIN, 1);
-            vTaskDelay(pdMS_TO_TICKS(2000));
-            gpio_set_level(GREEN_LED_PIN, 0);
-            ESP_LOGI(TAG, "LED OFF");
+    listener_command_t item;
+    while (1)
+    {
+        if (xQueueReceive(command_queue, &item, portMAX_DELAY) == pdTRUE) {
+            udp_listener_execute(&item);
+            metrics_observe(METRIC_COMMAND_WAIT_US, (uint32_t)(agv_proto_now_us() - item.received_us));
         }
     }
     vTaskDelete(NULL);
@@ -1,6 +1,12 @@
 #ifndef UDP_LISTENER_H
 #define UDP_LISTENER_H
 
+#include <stdint.h>
+#include <stddef.h>
+
 void udp_listener_task(void *pvParameters);
 
-#endif
\ No newline at end of file
+// udp_service rx callback: queues server commands for udp_listener_task
+void udp_listener_on_datagram(const uint8_t *data, size_t len, void *arg);
+
+#endif
@@ -0,0 +1,248 @@
+// udp_reliable.c
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "udp_uplink.h"
+#include "metrics.h"
+#include "udp_reliable.h"
+
+static const char *TAG = "udp_reliable";
+
+#define RELIABLE_RETRY_US   1000        // Until the task holding a lock lets go
+
+typedef struct {
+    bool used;
+    uint8_t type;
+    uint8_t len;
+    uint8_t retries;
+    uint32_t seq;
+    uint32_t rto_us;            // Wait before the next retransmit
+    uint64_t timestamp_us;      // Event time, local, for the delivery trace
+    uint64_t event_us;          // Its udp_uplink_event_us() stamp, sent unchanged in every copy
+    uint64_t sent_us;           // First transmission, for RTT, 0 = held by an outage, no sample
+    uint64_t due_us;            // Next retransmit
+    uint8_t payload[UDP_RELIABLE_MAX_PAYLOAD];
+} reliable_slot_t;
+
+static struct {
+    udp_reliable_config_t config;
+    SemaphoreHandle_t lock;     // Producers, the transport task (ACKs) and the timer share the window
+    esp_timer_handle_t retx_timer;
+    reliable_slot_t slots[UDP_RELIABLE_WINDOW];
+    bool paused;                // Link down, copies wait in the offline store instead
+    udp_reliable_stats_t stats;
+} s_reliable;
+
+// Call with the lock held. The window is small, a scan is cheaper than keeping it sorted.
+static void reliable_arm_locked(uint64_t now) {
+    uint64_t next_due = UINT64_MAX;
+    for (int i = 0; i < UDP_RELIABLE_WINDOW; i++) {
+        if (s_reliable.slots[i].used && s_reliable.slots[i].due_us < next_due) next_due = s_reliable.slots[i].due_us;
+    }
+    esp_timer_stop(s_reliable.retx_timer);
+    if (next_due == UINT64_MAX || s_reliable.paused) return;
+    esp_timer_start_once(s_reliable.retx_timer, next_due > now ? next_due - now : 1);
+}
+
+// Runs in the esp_timer task; every copy due now goes out in one datagram.
+// Never blocks there, a copy that cannot be queued now is tried again shortly.
+static void reliable_retransmit(void *arg) {
+    const uint64_t now = agv_proto_now_us();
+    int due = 0;
+
+    if (xSemaphoreTake(s_reliable.lock, 0) != pdTRUE) {
+        esp_timer_start_once(s_reliable.retx_timer, RELIABLE_RETRY_US);
+        return;
+    }
+    for (int i = 0; i < UDP_RELIABLE_WINDOW; i++) {
+        reliable_slot_t *slot = &s_reliable.slots[i];
+        if (!slot->used || slot->due_us > now) continue;
+
+        if (slot->retries >= s_reliable.config.max_retries) {
+            ESP_LOGW(TAG, "Message #%" PRIu32 " not acknowledged after %d retransmits",
+                     slot->seq, slot->retries);
+            slot->used = false;
+            s_reliable.stats.expired++;
+            continue;
+        }
+        due++;
+    }
+    for (int i = 0; i < UDP_RELIABLE_WINDOW && due; i++) {
+        reliable_slot_t *slot = &s_reliable.slots[i];
+        if (!slot->used || slot->due_us > now) continue;
+
+        // The last copy sends the datagram
+        esp_err_t err = udp_uplink_try_post_seq(slot->type, slot->seq, slot->event_us, slot->payload, slot->len,
+                                                --due ? UDP_UPLINK_PRIO_NORMAL : UDP_UPLINK_PRIO_URGENT);
+        if (err != ESP_OK) {
+            // Not sent, so neither a retransmit nor a retry used up
+            slot->due_us = now + RELIABLE_RETRY_US;
+            continue;
+        }
+        slot->retries++;
+        slot->rto_us = slot->rto_us * 2 > s_reliable.config.max_rto_us ? s_reliable.config.max_rto_us
+                                                                        : slot->rto_us * 2;
+        slot->due_us = now + slot->rto_us;
+        s_reliable.stats.retransmits++;
+    }
+    reliable_arm_locked(now);
+    xSemaphoreGive(s_reliable.lock);
+}
+
+esp_err_t udp_reliable_init(const udp_reliable_config_t *config) {
+    if (s_reliable.lock) return ESP_ERR_INVALID_STATE;
+
+    memset(&s_reliable, 0, sizeof(s_reliable));
+    s_reliable.paused = true;
+    if (config) s_reliable.config = *config;
+    if (s_reliable.config.rto_us == 0) s_reliable.config.rto_us = UDP_RELIABLE_DEFAULT_RTO_US;
+    if (s_reliable.config.max_rto_us < s_reliable.config.rto_us) {
+        s_reliable.config.max_rto_us = s_reliable.config.rto_us > UDP_RELIABLE_DEFAULT_MAX_RTO_US
+                                       ? s_reliable.config.rto_us : UDP_RELIABLE_DEFAULT_MAX_RTO_US;
+    }
+    if (s_reliable.config.max_retries == 0) s_reliable.config.max_retries = UDP_RELIABLE_DEFAULT_MAX_RETRIES;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = reliable_retransmit,
+        .name = "udp_reliable",
+    };
+    if (esp_timer_create(&timer_args, &s_reliable.retx_timer) != ESP_OK) return ESP_ERR_NO_MEM;
+
+    s_reliable.lock = xSemaphoreCreateMutex();
+    if (!s_reliable.lock) {
+        esp_timer_delete(s_reliable.retx_timer);
+        s_reliable.retx_timer = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "%d in flight, retransmit after %" PRIu32 " us up to %" PRIu32 " us, %d retries",
+             UDP_RELIABLE_WINDOW, s_reliable.config.rto_us, s_reliable.config.max_rto_us,
+             s_reliable.config.max_retries);
+    return ESP_OK;
+}
+
+esp_err_t udp_reliable_post(agv_msg_type_t type, const void *payload, size_t len) {
+    if (!s_reliable.lock) return ESP_ERR_INVALID_STATE;
+    if (len > UDP_RELIABLE_MAX_PAYLOAD) return ESP_ERR_INVALID_ARG;
+    const uint64_t now = agv_proto_now_us();
+
+    xSemaphoreTake(s_reliable.lock, portMAX_DELAY);
+    reliable_slot_t *slot = NULL;
+    for (int i = 0; i < UDP_RELIABLE_WINDOW && !slot; i++) {
+        if (!s_reliable.slots[i].used) slot = &s_reliable.slots[i];
+    }
+    if (!slot) {
+        s_reliable.stats.window_full++;
+        xSemaphoreGive(s_reliable.lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    *slot = (reliable_slot_t) {
+        .type = type,
+        .len = (uint8_t)len,
+        .seq = agv_proto_next_seq(),
+        .rto_us = s_reliable.config.rto_us,
+        .timestamp_us = now,
+        .event_us = udp_uplink_event_us(now),
+        .sent_us = s_reliable.paused ? 0 : now,
+        .due_us = now + s_reliable.config.rto_us,
+    };
+    memcpy(slot->payload, payload, len);
+
+    // A failed send is left to the retransmit timer, only a malformed message is refused
+    esp_err_t err = udp_uplink_post_seq(type, slot->seq, slot->event_us, payload, len, UDP_UPLINK_PRIO_URGENT);
+    if (err == ESP_ERR_INVALID_ARG || err == ESP_ERR_INVALID_STATE) {
+        xSemaphoreGive(s_reliable.lock);
+        return err;
+    }
+    slot->used = true;
+    s_reliable.stats.sent++;
+    reliable_arm_locked(now);
+    xSemaphoreGive(s_reliable.lock);
+    return ESP_OK;
+}
+
+// Delivery breakdown of one acknowledged tag. Both ends' stamps are only ever subtracted
+// from a stamp of the same clock, so no clock sync is needed.
+static void reliable_trace(const reliable_slot_t *slot, const agv_msg_ack_t *ack, uint64_t server_tx_us,
+                           uint64_t now) {
+    if (slot->type != AGV_MSG_TAG || !ack->echo_tx_us || ack->echo_tx_us < slot->timestamp_us ||
+        ack->echo_tx_us > now || !server_tx_us || server_tx_us < ack->rx_us) {
+        return;
+    }
+    const uint64_t server_us = server_tx_us - ack->rx_us;
+    const uint64_t round_trip_us = now - ack->echo_tx_us;
+    metrics_observe(METRIC_TAG_QUEUE_US, (uint32_t)(ack->echo_tx_us - slot->timestamp_us));
+    metrics_observe(METRIC_TAG_SERVER_US, (uint32_t)server_us);
+    metrics_observe(METRIC_TAG_WIFI_US, round_trip_us > server_us ? (uint32_t)((round_trip_us - server_us) / 2) : 0);
+}
+
+// Runs in the udp_service transport task
+void udp_reliable_on_ack(const agv_msg_ack_t *ack, uint64_t server_tx_us) {
+    if (!s_reliable.lock || !ack->mask) return;
+    const uint64_t now = agv_proto_now_us();
+    uint32_t acked = 0;
+
+    xSemaphoreTake(s_reliable.lock, portMAX_DELAY);
+    for (int i = 0; i < UDP_RELIABLE_WINDOW; i++) {
+        reliable_slot_t *slot = &s_reliable.slots[i];
+        const uint32_t offset = slot->seq - ack->base_seq;
+        if (!slot->used || offset >= 32 || !(ack->mask & (1u << offset))) continue;
+
+        // Karn: a retransmitted message's ACK may answer any of its copies
+        if (slot->retries == 0 && slot->sent_us) {
+            const uint32_t rtt_us = (uint32_t)(now - slot->sent_us);
+            s_reliable.stats.last_rtt_us = rtt_us;
+            if (rtt_us > s_reliable.stats.max_rtt_us) s_reliable.stats.max_rtt_us = rtt_us;
+        }
+        // The echoed stamp names the copy that got through, so retransmits are fine here
+        reliable_trace(slot, ack, server_tx_us, now);
+        slot->used = false;
+        acked++;
+    }
+    s_reliable.stats.acked += acked;
+    s_reliable.stats.stale_acks += __builtin_popcount(ack->mask) - acked;
+    if (acked) reliable_arm_locked(now);
+    xSemaphoreGive(s_reliable.lock);
+}
+
+void udp_reliable_set_paused(bool paused) {
+    if (!s_reliable.lock) return;
+    const uint64_t now = agv_proto_now_us();
+
+    xSemaphoreTake(s_reliable.lock, portMAX_DELAY);
+    for (int i = 0; i < UDP_RELIABLE_WINDOW; i++) {
+        reliable_slot_t *slot = &s_reliable.slots[i];
+        if (!slot->used) continue;
+        // The outage would count as round trip time
+        if (paused) slot->sent_us = 0;
+        // The stored copies go out first, give their ACKs a full timeout
+        else if (s_reliable.paused) slot->due_us = now + slot->rto_us;
+    }
+    s_reliable.paused = paused;
+    reliable_arm_locked(now);
+    xSemaphoreGive(s_reliable.lock);
+}
+
+void udp_reliable_get_stats(udp_reliable_stats_t *stats) {
+    if (!stats) return;
+    if (!s_reliable.lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(s_reliable.lock, portMAX_DELAY);
+    *stats = s_reliable.stats;
+    xSemaphoreGive(s_reliable.lock);
+}
+
+void udp_reliable_deinit(void) {
+    if (!s_reliable.lock) return;
+    esp_timer_stop(s_reliable.retx_timer);
+    esp_timer_delete(s_reliable.retx_timer);
+    s_reliable.retx_timer = NULL;
+    vSemaphoreDelete(s_reliable.lock);
+    s_reliable.lock = NULL;
+}
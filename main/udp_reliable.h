@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "agv_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UDP_RELIABLE_WINDOW                 16      // Messages awaiting an ACK at once
+#define UDP_RELIABLE_MAX_PAYLOAD            sizeof(agv_msg_tag_t)
+#define UDP_RELIABLE_DEFAULT_RTO_US         50000   // First retransmit, a few Wi-Fi round trips
+#define UDP_RELIABLE_DEFAULT_MAX_RTO_US     1000000
+#define UDP_RELIABLE_DEFAULT_MAX_RETRIES    8
+
+typedef struct {
+    uint32_t rto_us;            // Delay before the first retransmit, doubled after each one, 0 = default
+    uint32_t max_rto_us;        // Backoff cap, 0 = default
+    uint8_t max_retries;        // Retransmits before a message is given up, 0 = default
+} udp_reliable_config_t;
+
+typedef struct {
+    uint32_t sent;              // Messages accepted by udp_reliable_post()
+    uint32_t acked;
+    uint32_t retransmits;
+    uint32_t expired;           // Given up after max_retries
+    uint32_t window_full;       // Posts refused because UDP_RELIABLE_WINDOW messages were in flight
+    uint32_t stale_acks;        // ACKed seqs no longer in flight, e.g. a second ACK after a retransmit
+    uint32_t last_rtt_us;       // Send to ACK, measured on messages that were not retransmitted
+    uint32_t max_rtt_us;
+} udp_reliable_stats_t;
+
+/**
+ * @brief Start the retransmit timer, udp_uplink_init() must have been called
+ *
+ * Starts paused.
+ *
+ * @param config Timing, NULL for the defaults
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if already started, or ESP_ERR_NO_MEM
+ */
+esp_err_t udp_reliable_init(const udp_reliable_config_t *config);
+
+/**
+ * @brief Send a message urgently and keep retransmitting it until it is acknowledged
+ *
+ * Never blocks on the network: the first copy goes through udp_uplink_post_seq()
+ * and retransmits run from an esp_timer.
+ *
+ * @param type    Message type the server acknowledges (AGV_MSG_TAG)
+ * @param payload Payload of exactly the size defined for type, at most UDP_RELIABLE_MAX_PAYLOAD
+ * @param len     Payload length
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if not started, ESP_ERR_INVALID_ARG for a bad length,
+ *         or ESP_ERR_NO_MEM if the in-flight window is full and the message was not sent
+ */
+esp_err_t udp_reliable_post(agv_msg_type_t type, const void *payload, size_t len);
+
+/**
+ * @brief Handle an ACK from the server, called by the receive path
+ *
+ * For every tag it acknowledges, the time from post to the sendto() of the copy that
+ * got through, half the network round trip and the server's hold time are recorded
+ * in the METRIC_TAG_* histograms.
+ *
+ * @param ack          ACK payload
+ * @param server_tx_us tx_us of the datagram that carried the ACK, server time, 0 = unknown
+ */
+void udp_reliable_on_ack(const agv_msg_ack_t *ack, uint64_t server_tx_us);
+
+/**
+ * @brief Hold retransmits while the link is down
+ *
+ * Messages posted meanwhile still reach the uplink, which keeps them in the
+ * offline store. Retries are not used up during an outage; on resume every
+ * message in flight gets a full timeout before its first retransmit.
+ * Ignored before udp_reliable_init().
+ */
+void udp_reliable_set_paused(bool paused);
+
+/**
+ * @brief Read the delivery counters
+ */
+void udp_reliable_get_stats(udp_reliable_stats_t *stats);
+
+/**
+ * @brief Stop retransmitting, messages still in flight are dropped
+ */
+void udp_reliable_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
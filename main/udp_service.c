@@ -1,21 +1,170 @@
 #include "udp_service.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_vfs_eventfd.h"
+#include "lwip/sockets.h"
+#include "agv_proto.h"
+#include "metrics.h"
 #include <string.h>
+#include <unistd.h>
+
+#define TX_SLOT_MASK (UDP_SERVICE_TX_SLOTS - 1)
+
+_Static_assert((UDP_SERVICE_TX_SLOTS & TX_SLOT_MASK) == 0, "UDP_SERVICE_TX_SLOTS must be a power of two");
+
+// Bounded MPSC ring: a slot belongs to producers while seq == position,
+// and to the transport task once the producer publishes seq == position + 1
+typedef struct {
+    uint32_t seq;
+    uint16_t len;
+    uint8_t data[AGV_PROTO_MAX_DGRAM];
+} tx_slot_t;
 
 static const char *TAG = "udp_service";
 static int udp_sock = -1;
+static int tx_event_fd = -1;    // Wakes the transport task out of select()
 static struct sockaddr_in dest_addr;
+static TaskHandle_t transport_task;
+static TaskHandle_t stop_waiter;
+static volatile bool stop_requested;
+static udp_service_rx_cb_t rx_cb;
+static void *rx_cb_arg;
+
+static tx_slot_t tx_ring[UDP_SERVICE_TX_SLOTS];
+static uint32_t tx_head;        // Next position to claim, shared by producers
+static uint32_t tx_tail;        // Next position to send, transport task only
+static udp_service_stats_t stats;
+
+static void udp_service_wake(void)
+{
+    uint64_t one = 1;
+    write(tx_event_fd, &one, sizeof(one));
+}
+
+static bool tx_ring_push(const char *data, size_t len)
+{
+    uint32_t pos = __atomic_load_n(&tx_head, __ATOMIC_RELAXED);
+    tx_slot_t *slot;
+
+    for (;;) {
+        slot = &tx_ring[pos & TX_SLOT_MASK];
+        int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&tx_head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;   // Transport task has not sent this slot yet
+        } else {
+            pos = __atomic_load_n(&tx_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    memcpy(slot->data, data, len);
+    slot->len = (uint16_t)len;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void tx_ring_drain(void)
+{
+    for (;;) {
+        tx_slot_t *slot = &tx_ring[tx_tail & TX_SLOT_MASK];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tx_tail + 1) return;
+
+        // As late as possible: the server echoes it back to time the round trip
+        const uint64_t start_us = agv_proto_now_us();
+        agv_proto_stamp_tx(slot->data, slot->len, start_us);
+        int err = sendto(udp_sock, slot->data, slot->len, 0,
+                         (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+        metrics_observe(METRIC_UDP_SENDTO_US, (uint32_t)(agv_proto_now_us() - start_us));
+        if (err < 0) {
+            __atomic_fetch_add(&stats.tx_errors, 1, __ATOMIC_RELAXED);
+            metrics_inc(METRIC_UDP_TX_ERRORS);
+            ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+        } else {
+            __atomic_fetch_add(&stats.tx_datagrams, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&slot->seq, tx_tail + UDP_SERVICE_TX_SLOTS, __ATOMIC_RELEASE);
+        tx_tail++;
+    }
+}
 
-esp_err_t udp_service_init(const char *ip, uint16_t port)
+static void udp_service_receive(void)
+{
+    static uint8_t rx_buf[AGV_PROTO_MAX_DGRAM];     // Transport task only
+
+    struct sockaddr_in sender_addr;
+    socklen_t addr_len = sizeof(sender_addr);
+    int len = recvfrom(udp_sock, rx_buf, sizeof(rx_buf), MSG_DONTWAIT,
+                       (struct sockaddr *)&sender_addr, &addr_len);
+    if (len < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            __atomic_fetch_add(&stats.rx_errors, 1, __ATOMIC_RELAXED);
+            ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
+        }
+        return;
+    }
+    __atomic_fetch_add(&stats.rx_datagrams, 1, __ATOMIC_RELAXED);
+    metrics_inc(METRIC_UDP_RX_DATAGRAMS);
+    if (rx_cb) rx_cb(rx_buf, (size_t)len, rx_cb_arg);
+}
+
+static void udp_transport_task(void *arg)
+{
+    const int max_fd = udp_sock > tx_event_fd ? udp_sock : tx_event_fd;
+
+    while (!stop_requested) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(udp_sock, &rfds);
+        FD_SET(tx_event_fd, &rfds);
+
+        int ready = select(max_fd + 1, &rfds, NULL, NULL, NULL);
+        if (ready < 0) {
+            ESP_LOGE(TAG, "select failed: errno %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+        if (FD_ISSET(tx_event_fd, &rfds)) {
+            uint64_t count;
+            read(tx_event_fd, &count, sizeof(count));
+        }
+        tx_ring_drain();
+        if (FD_ISSET(udp_sock, &rfds)) udp_service_receive();
+    }
+
+    tx_ring_drain();
+    xTaskNotifyGive(stop_waiter);
+    vTaskDelete(NULL);
+}
+
+esp_err_t udp_service_init(const char *ip, uint16_t port, udp_service_rx_cb_t cb, void *cb_arg)
 {
     if (udp_sock != -1) {
         ESP_LOGW(TAG, "UDP socket already initialized");
         return ESP_OK;
     }
 
+    const esp_vfs_eventfd_config_t eventfd_config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    esp_err_t ret = esp_vfs_eventfd_register(&eventfd_config);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {    // Already registered is fine
+        ESP_LOGE(TAG, "Unable to register eventfd: %s", esp_err_to_name(ret));
+        return ESP_FAIL;
+    }
+    tx_event_fd = eventfd(0, 0);
+    if (tx_event_fd < 0) {
+        ESP_LOGE(TAG, "Unable to create eventfd: errno %d", errno);
+        return ESP_FAIL;
+    }
+
     udp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
     if (udp_sock < 0) {
         ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        close(tx_event_fd);
+        tx_event_fd = -1;
         return ESP_FAIL;
     }
 
@@ -23,6 +172,23 @@ esp_err_t udp_service_init(const char *ip, uint16_t port)
     dest_addr.sin_family = AF_INET;
     dest_addr.sin_port = htons(port);
 
+    for (uint32_t i = 0; i < UDP_SERVICE_TX_SLOTS; i++) tx_ring[i].seq = i;
+    tx_head = tx_tail = 0;
+    memset(&stats, 0, sizeof(stats));
+    rx_cb = cb;
+    rx_cb_arg = cb_arg;
+    stop_requested = false;
+
+    if (xTaskCreate(udp_transport_task, "udp_transport", UDP_SERVICE_TASK_STACK, NULL,
+                    UDP_SERVICE_TASK_PRIORITY, &transport_task) != pdPASS) {
+        ESP_LOGE(TAG, "Unable to create transport task");
+        close(udp_sock);
+        udp_sock = -1;
+        close(tx_event_fd);
+        tx_event_fd = -1;
+        return ESP_FAIL;
+    }
+
     ESP_LOGI(TAG, "UDP initialized to %s:%d", ip, port);
     return ESP_OK;
 }
@@ -33,21 +199,40 @@ int udp_service_send(const char *data, size_t len)
         ESP_LOGE(TAG, "UDP socket not initialized");
         return -1;
     }
-
-    int err = sendto(udp_sock, data, len, 0,
-                     (struct sockaddr *)&dest_addr, sizeof(dest_addr));
-    if (err < 0) {
-        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+    if (len > AGV_PROTO_MAX_DGRAM || !tx_ring_push(data, len)) {
+        __atomic_fetch_add(&stats.tx_dropped, 1, __ATOMIC_RELAXED);
+        metrics_inc(METRIC_UDP_TX_DROPPED);
+        return -1;
     }
-    return err;
+    metrics_inc(METRIC_UDP_TX_QUEUED);
+    udp_service_wake();
+    return (int)len;
+}
+
+void udp_service_get_stats(udp_service_stats_t *out)
+{
+    if (!out) return;
+    out->tx_datagrams = __atomic_load_n(&stats.tx_datagrams, __ATOMIC_RELAXED);
+    out->tx_dropped = __atomic_load_n(&stats.tx_dropped, __ATOMIC_RELAXED);
+    out->tx_errors = __atomic_load_n(&stats.tx_errors, __ATOMIC_RELAXED);
+    out->rx_datagrams = __atomic_load_n(&stats.rx_datagrams, __ATOMIC_RELAXED);
+    out->rx_errors = __atomic_load_n(&stats.rx_errors, __ATOMIC_RELAXED);
 }
 
 void udp_service_deinit(void)
 {
     if (udp_sock != -1) {
+        stop_waiter = xTaskGetCurrentTaskHandle();
+        stop_requested = true;
+        udp_service_wake();
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        transport_task = NULL;
+
         shutdown(udp_sock, 0);
         close(udp_sock);
         udp_sock = -1;
+        close(tx_event_fd);
+        tx_event_fd = -1;
         ESP_LOGI(TAG, "UDP socket closed");
     }
 }
@@ -1,33 +1,69 @@
 #ifndef UDP_SERVICE_H
 #define UDP_SERVICE_H
 
+#include <stdint.h>
+#include <stddef.h>
 #include "esp_err.h"
-#include "lwip/sockets.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define UDP_SERVICE_TX_SLOTS        8       // Outbound queue depth, power of two
+#define UDP_SERVICE_TASK_STACK      4096
+#define UDP_SERVICE_TASK_PRIORITY   6       // Above the producers, so queued datagrams leave promptly
+
+/**
+ * @brief Called from the transport task for every datagram received from the server
+ *
+ * @param data Datagram, valid only during the call
+ * @param len  Datagram length
+ * @param arg  User argument given to udp_service_init()
+ */
+typedef void (*udp_service_rx_cb_t)(const uint8_t *data, size_t len, void *arg);
+
+typedef struct {
+    uint32_t tx_datagrams;      // Datagrams sent
+    uint32_t tx_dropped;        // Datagrams rejected because the outbound queue was full
+    uint32_t tx_errors;         // sendto failures
+    uint32_t rx_datagrams;      // Datagrams received
+    uint32_t rx_errors;         // recvfrom failures
+} udp_service_stats_t;
+
 /**
- * @brief Initialize UDP socket for sending data
+ * @brief Open the UDP socket and start the transport task that owns it
  *
- * @param ip   Destination IP (as string, e.g. "192.168.1.100")
- * @param port Destination port (e.g. 3333)
+ * The transport task is the only user of the socket: it sends everything queued
+ * with udp_service_send() and passes received datagrams to rx_cb.
+ *
+ * @param ip     Destination IP (as string, e.g. "192.168.1.100")
+ * @param port   Destination port (e.g. 3333)
+ * @param rx_cb  Callback for received datagrams, may be NULL
+ * @param rx_arg User argument for rx_cb
  * @return ESP_OK on success, ESP_FAIL otherwise
  */
-esp_err_t udp_service_init(const char *ip, uint16_t port);
+esp_err_t udp_service_init(const char *ip, uint16_t port, udp_service_rx_cb_t rx_cb, void *rx_arg);
 
 /**
- * @brief Send a message over UDP
+ * @brief Queue a datagram for the transport task
+ *
+ * Copies data into a lock-free outbound queue and returns without touching lwIP,
+ * so it is safe to call from any task. A datagram in the agv_proto format gets
+ * its tx_us stamped right before sendto().
  *
  * @param data Pointer to data buffer
  * @param len  Length of data
- * @return Number of bytes sent, or -1 on error
+ * @return len if queued, or -1 if not initialized, too long or the queue is full
  */
 int udp_service_send(const char *data, size_t len);
 
 /**
- * @brief Close the UDP socket
+ * @brief Read the transport counters
+ */
+void udp_service_get_stats(udp_service_stats_t *stats);
+
+/**
+ * @brief Send what is still queued, stop the transport task and close the socket
  */
 void udp_service_deinit(void);
 
@@ -0,0 +1,208 @@
+// udp_store.c
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "udp_store.h"
+
+static const char *TAG = "udp_store";
+
+// Byte ring of records {uint16_t len, data[len]}, oldest at head
+static struct {
+    udp_store_config_t config;
+    SemaphoreHandle_t lock;         // Producers (through the uplink), the drain timer and link events
+    esp_timer_handle_t drain_timer;
+    uint8_t *ring;
+    size_t head;
+    size_t used;
+    bool online;
+    bool draining;
+    udp_store_stats_t stats;
+} s_store;
+
+static void ring_copy_in(size_t pos, const void *data, size_t len) {
+    const size_t first = len < s_store.config.capacity - pos ? len : s_store.config.capacity - pos;
+    memcpy(&s_store.ring[pos], data, first);
+    memcpy(s_store.ring, (const uint8_t *)data + first, len - first);
+}
+
+static void ring_copy_out(size_t pos, void *data, size_t len) {
+    const size_t first = len < s_store.config.capacity - pos ? len : s_store.config.capacity - pos;
+    memcpy(data, &s_store.ring[pos], first);
+    memcpy((uint8_t *)data + first, s_store.ring, len - first);
+}
+
+// Call with the lock held
+static uint16_t store_peek_len_locked(void) {
+    uint16_t len;
+    ring_copy_out(s_store.head, &len, sizeof(len));
+    return len;
+}
+
+// Call with the lock held
+static void store_pop_locked(void) {
+    const size_t record = sizeof(uint16_t) + store_peek_len_locked();
+    s_store.head = (s_store.head + record) % s_store.config.capacity;
+    s_store.used -= record;
+    s_store.stats.depth--;
+    s_store.stats.bytes = s_store.used;
+}
+
+// Call with the lock held
+static bool store_push_locked(const char *data, size_t len) {
+    const size_t record = sizeof(uint16_t) + len;
+    if (len > AGV_PROTO_MAX_DGRAM || record > s_store.config.capacity) {
+        s_store.stats.dropped++;
+        return false;
+    }
+    while (s_store.config.capacity - s_store.used < record) {
+        s_store.stats.dropped++;
+        if (s_store.config.overflow == UDP_STORE_DROP_NEWEST) return false;
+        store_pop_locked();
+    }
+
+    const uint16_t len16 = (uint16_t)len;
+    const size_t tail = (s_store.head + s_store.used) % s_store.config.capacity;
+    ring_copy_in(tail, &len16, sizeof(len16));
+    ring_copy_in((tail + sizeof(len16)) % s_store.config.capacity, data, len);
+    s_store.used += record;
+    s_store.stats.stored++;
+    s_store.stats.bytes = s_store.used;
+    if (++s_store.stats.depth > s_store.stats.max_depth) s_store.stats.max_depth = s_store.stats.depth;
+    return true;
+}
+
+// Call with the lock held
+static void store_start_drain_locked(void) {
+    if (s_store.draining || s_store.used == 0) return;
+    s_store.draining = true;
+    esp_timer_start_periodic(s_store.drain_timer, s_store.config.drain_interval_us);
+}
+
+// Call with the lock held
+static void store_stop_drain_locked(void) {
+    if (!s_store.draining) return;
+    s_store.draining = false;
+    esp_timer_stop(s_store.drain_timer);
+}
+
+// Runs in the esp_timer task, a burst at a time so a long outage does not flood the transport queue.
+// Never blocks there: while a producer holds the lock, the next tick of the periodic timer retries.
+static void store_drain(void *arg) {
+    static uint8_t dgram[AGV_PROTO_MAX_DGRAM];     // Guarded by the lock
+
+    if (xSemaphoreTake(s_store.lock, 0) != pdTRUE) return;
+    for (int i = 0; i < s_store.config.drain_burst && s_store.online && s_store.used; i++) {
+        const uint16_t len = store_peek_len_locked();
+        ring_copy_out((s_store.head + sizeof(len)) % s_store.config.capacity, dgram, len);
+        // Sink full: keep the datagram at the head and retry on the next tick
+        if (s_store.config.send((const char *)dgram, len) < 0) break;
+        store_pop_locked();
+        s_store.stats.forwarded++;
+    }
+    if (!s_store.online || s_store.used == 0) {
+        store_stop_drain_locked();
+        if (s_store.used == 0) ESP_LOGI(TAG, "Drained, %" PRIu32 " datagrams forwarded", s_store.stats.forwarded);
+    }
+    xSemaphoreGive(s_store.lock);
+}
+
+esp_err_t udp_store_init(const udp_store_config_t *config) {
+    if (!config || !config->send) return ESP_ERR_INVALID_ARG;
+    if (s_store.lock) return ESP_ERR_INVALID_STATE;
+
+    memset(&s_store, 0, sizeof(s_store));
+    s_store.config = *config;
+    if (s_store.config.capacity == 0) s_store.config.capacity = UDP_STORE_DEFAULT_CAPACITY;
+    if (s_store.config.drain_interval_us == 0) s_store.config.drain_interval_us = UDP_STORE_DEFAULT_DRAIN_US;
+    if (s_store.config.drain_burst == 0) s_store.config.drain_burst = UDP_STORE_DEFAULT_DRAIN_BURST;
+
+    s_store.ring = malloc(s_store.config.capacity);
+    if (!s_store.ring) return ESP_ERR_NO_MEM;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = store_drain,
+        .name = "udp_store",
+    };
+    if (esp_timer_create(&timer_args, &s_store.drain_timer) != ESP_OK) {
+        free(s_store.ring);
+        s_store.ring = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_store.lock = xSemaphoreCreateMutex();
+    if (!s_store.lock) {
+        esp_timer_delete(s_store.drain_timer);
+        free(s_store.ring);
+        s_store.ring = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "%u byte store, drop %s on overflow", (unsigned)s_store.config.capacity,
+             s_store.config.overflow == UDP_STORE_DROP_NEWEST ? "newest" : "oldest");
+    return ESP_OK;
+}
+
+int udp_store_send(const char *data, size_t len) {
+    if (!s_store.lock) return -1;
+    int ret = (int)len;
+
+    xSemaphoreTake(s_store.lock, portMAX_DELAY);
+    // Straight through only when nothing older is waiting
+    if (s_store.online && s_store.used == 0) {
+        ret = s_store.config.send(data, len);
+        if (ret >= 0) {
+            xSemaphoreGive(s_store.lock);
+            return ret;
+        }
+        ret = (int)len;
+    }
+    if (!store_push_locked(data, len)) ret = -1;
+    if (s_store.online) store_start_drain_locked();
+    xSemaphoreGive(s_store.lock);
+    return ret;
+}
+
+void udp_store_set_online(bool online) {
+    if (!s_store.lock) return;
+
+    xSemaphoreTake(s_store.lock, portMAX_DELAY);
+    if (online == s_store.online) {
+        xSemaphoreGive(s_store.lock);
+        return;
+    }
+    s_store.online = online;
+    if (online) {
+        ESP_LOGI(TAG, "Online, forwarding %" PRIu32 " stored datagrams", s_store.stats.depth);
+        store_start_drain_locked();
+    } else {
+        s_store.stats.outages++;
+        store_stop_drain_locked();
+    }
+    xSemaphoreGive(s_store.lock);
+}
+
+void udp_store_get_stats(udp_store_stats_t *stats) {
+    if (!stats) return;
+    if (!s_store.lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(s_store.lock, portMAX_DELAY);
+    *stats = s_store.stats;
+    xSemaphoreGive(s_store.lock);
+}
+
+void udp_store_deinit(void) {
+    if (!s_store.lock) return;
+    esp_timer_stop(s_store.drain_timer);
+    esp_timer_delete(s_store.drain_timer);
+    s_store.drain_timer = NULL;
+    vSemaphoreDelete(s_store.lock);
+    s_store.lock = NULL;
+    free(s_store.ring);
+    s_store.ring = NULL;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "udp_uplink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UDP_STORE_DEFAULT_CAPACITY      16384   // Bytes of RAM, about 350 single-tag datagrams
+#define UDP_STORE_DEFAULT_DRAIN_US      5000
+#define UDP_STORE_DEFAULT_DRAIN_BURST   4       // Half the transport queue, leaves room for live traffic
+
+typedef enum {
+    UDP_STORE_DROP_OLDEST = 0,      // Make room by discarding the oldest stored datagrams
+    UDP_STORE_DROP_NEWEST,          // Keep what is stored and refuse the new datagram
+} udp_store_overflow_t;
+
+typedef struct {
+    udp_uplink_send_fn_t send;      // Usually udp_service_send
+    size_t capacity;                // Ring size in bytes, 0 = default
+    uint32_t drain_interval_us;     // Time between drain bursts after reconnecting, 0 = default
+    uint8_t drain_burst;            // Datagrams per burst, 0 = default
+    udp_store_overflow_t overflow;
+} udp_store_config_t;
+
+typedef struct {
+    uint32_t stored;                // Datagrams queued because the link was down or the sink was full
+    uint32_t forwarded;             // Stored datagrams handed to the sink later
+    uint32_t dropped;               // Datagrams lost to the overflow policy
+    uint32_t depth;                 // Datagrams stored now
+    uint32_t max_depth;
+    uint32_t bytes;                 // Bytes stored now
+    uint32_t outages;               // Online to offline transitions
+} udp_store_stats_t;
+
+/**
+ * @brief Allocate the ring and start offline
+ *
+ * @param config Sink and ring settings, send is required
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE if already started, or ESP_ERR_NO_MEM
+ */
+esp_err_t udp_store_init(const udp_store_config_t *config);
+
+/**
+ * @brief Uplink sink: send now when online and nothing is stored, otherwise append to the ring
+ *
+ * Stored datagrams always leave before newer ones, so the server sees them in order.
+ *
+ * @return len, or -1 if the datagram was dropped
+ */
+int udp_store_send(const char *data, size_t len);
+
+/**
+ * @brief Report the link state, from the Wi-Fi event handler
+ *
+ * Going online starts draining the ring at drain_burst datagrams per
+ * drain_interval_us. Ignored before udp_store_init().
+ */
+void udp_store_set_online(bool online);
+
+/**
+ * @brief Read the ring counters
+ */
+void udp_store_get_stats(udp_store_stats_t *stats);
+
+/**
+ * @brief Stop draining and free the ring, stored datagrams are lost
+ */
+void udp_store_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
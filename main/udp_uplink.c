@@ -0,0 +1,173 @@
+// udp_uplink.c
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "udp_uplink.h"
+#include "clock_sync.h"
+
+static const char *TAG = "udp_uplink";
+
+#define UPLINK_WINDOW_RETRY_US  1000    // Until a producer holding the lock lets go
+
+typedef enum {
+    FLUSH_SIZE,
+    FLUSH_COUNT,
+    FLUSH_WINDOW,
+    FLUSH_URGENT,
+} flush_reason_t;
+
+static struct {
+    udp_uplink_config_t config;
+    SemaphoreHandle_t lock;         // Guards dgram and stats, producers run in several tasks
+    esp_timer_handle_t window_timer;
+    agv_proto_dgram_t dgram;        // Pending events
+    udp_uplink_stats_t stats;
+} s_uplink;
+
+// Call with the lock held
+static int uplink_flush_locked(flush_reason_t reason) {
+    if (s_uplink.dgram.count == 0) return 0;
+
+    // Nothing left to wait for; a no-op if the window already fired
+    if (reason != FLUSH_WINDOW) esp_timer_stop(s_uplink.window_timer);
+
+    int sent = s_uplink.config.send((const char *)s_uplink.dgram.buf, s_uplink.dgram.len);
+    s_uplink.stats.datagrams++;
+    if (sent < 0) s_uplink.stats.send_errors++;
+    switch (reason) {
+    case FLUSH_SIZE:   s_uplink.stats.flush_size++; break;
+    case FLUSH_COUNT:  s_uplink.stats.flush_count++; break;
+    case FLUSH_WINDOW: s_uplink.stats.flush_window++; break;
+    case FLUSH_URGENT: s_uplink.stats.flush_urgent++; break;
+    }
+    agv_proto_dgram_init(&s_uplink.dgram);
+    return sent;
+}
+
+// Runs in the esp_timer task once the oldest pending event reaches the window.
+// Never blocks there, every other timer would wait behind a producer's send.
+static void uplink_window_expired(void *arg) {
+    if (xSemaphoreTake(s_uplink.lock, 0) != pdTRUE) {
+        // A producer that flushes first stops the retry; already armed by one is fine too
+        esp_timer_start_once(s_uplink.window_timer, UPLINK_WINDOW_RETRY_US);
+        return;
+    }
+    uplink_flush_locked(FLUSH_WINDOW);
+    xSemaphoreGive(s_uplink.lock);
+}
+
+esp_err_t udp_uplink_init(const udp_uplink_config_t *config) {
+    if (!config || !config->send) return ESP_ERR_INVALID_ARG;
+    if (s_uplink.lock) return ESP_ERR_INVALID_STATE;
+
+    s_uplink.config = *config;
+    if (s_uplink.config.flush_window_us == 0) s_uplink.config.flush_window_us = UDP_UPLINK_DEFAULT_WINDOW_US;
+    if (s_uplink.config.max_events == 0) s_uplink.config.max_events = UDP_UPLINK_DEFAULT_MAX_EVENTS;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = uplink_window_expired,
+        .name = "udp_uplink",
+    };
+    if (esp_timer_create(&timer_args, &s_uplink.window_timer) != ESP_OK) return ESP_ERR_NO_MEM;
+
+    s_uplink.lock = xSemaphoreCreateMutex();
+    if (!s_uplink.lock) {
+        esp_timer_delete(s_uplink.window_timer);
+        s_uplink.window_timer = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(&s_uplink.stats, 0, sizeof(s_uplink.stats));
+    agv_proto_dgram_init(&s_uplink.dgram);
+    ESP_LOGI(TAG, "Uplink window %" PRIu32 " us, up to %u events per datagram",
+             s_uplink.config.flush_window_us, s_uplink.config.max_events);
+    return ESP_OK;
+}
+
+uint64_t udp_uplink_event_us(uint64_t local_us) {
+    const uint64_t fleet_us = clock_sync_fleet_us(local_us);
+    return fleet_us ? fleet_us : local_us;
+}
+
+// seq is only used when has_seq is set, otherwise the next one is assigned on append
+static bool uplink_append_locked(agv_msg_type_t type, bool has_seq, uint32_t seq, uint64_t timestamp_us,
+                                 const void *payload, size_t len) {
+    if (has_seq) return agv_proto_dgram_append_seq(&s_uplink.dgram, type, seq, timestamp_us, payload, len);
+    return agv_proto_dgram_append(&s_uplink.dgram, type, timestamp_us, payload, len);
+}
+
+static esp_err_t uplink_post(agv_msg_type_t type, bool has_seq, uint32_t seq, uint64_t timestamp_us,
+                             const void *payload, size_t len, udp_uplink_prio_t prio, TickType_t wait) {
+    if (!s_uplink.lock) return ESP_ERR_INVALID_STATE;
+    // Before the lock, a malformed message must not flush what is pending
+    if (!agv_proto_msg_valid(type, len)) return ESP_ERR_INVALID_ARG;
+    esp_err_t ret = ESP_OK;
+
+    if (xSemaphoreTake(s_uplink.lock, wait) != pdTRUE) return ESP_ERR_TIMEOUT;
+    if (!uplink_append_locked(type, has_seq, seq, timestamp_us, payload, len)) {
+        // The datagram is full, every valid message fits an empty one
+        uplink_flush_locked(FLUSH_SIZE);
+        uplink_append_locked(type, has_seq, seq, timestamp_us, payload, len);
+    }
+    s_uplink.stats.events++;
+
+    if (prio == UDP_UPLINK_PRIO_URGENT) {
+        if (uplink_flush_locked(FLUSH_URGENT) < 0) ret = ESP_FAIL;
+    } else if (s_uplink.dgram.count >= s_uplink.config.max_events) {
+        uplink_flush_locked(FLUSH_COUNT);
+    } else if (s_uplink.dgram.count == 1) {
+        // First pending event opens the window
+        esp_timer_start_once(s_uplink.window_timer, s_uplink.config.flush_window_us);
+    }
+    xSemaphoreGive(s_uplink.lock);
+    return ret;
+}
+
+esp_err_t udp_uplink_post(agv_msg_type_t type, const void *payload, size_t len, udp_uplink_prio_t prio) {
+    return uplink_post(type, false, 0, udp_uplink_event_us(agv_proto_now_us()), payload, len, prio, portMAX_DELAY);
+}
+
+esp_err_t udp_uplink_post_seq(agv_msg_type_t type, uint32_t seq, uint64_t timestamp_us,
+                              const void *payload, size_t len, udp_uplink_prio_t prio) {
+    return uplink_post(type, true, seq, timestamp_us, payload, len, prio, portMAX_DELAY);
+}
+
+esp_err_t udp_uplink_try_post(agv_msg_type_t type, const void *payload, size_t len, udp_uplink_prio_t prio) {
+    return uplink_post(type, false, 0, udp_uplink_event_us(agv_proto_now_us()), payload, len, prio, 0);
+}
+
+esp_err_t udp_uplink_try_post_seq(agv_msg_type_t type, uint32_t seq, uint64_t timestamp_us,
+                                  const void *payload, size_t len, udp_uplink_prio_t prio) {
+    return uplink_post(type, true, seq, timestamp_us, payload, len, prio, 0);
+}
+
+void udp_uplink_flush(void) {
+    if (!s_uplink.lock) return;
+    xSemaphoreTake(s_uplink.lock, portMAX_DELAY);
+    uplink_flush_locked(FLUSH_URGENT);
+    xSemaphoreGive(s_uplink.lock);
+}
+
+void udp_uplink_get_stats(udp_uplink_stats_t *stats) {
+    if (!stats) return;
+    if (!s_uplink.lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(s_uplink.lock, portMAX_DELAY);
+    *stats = s_uplink.stats;
+    xSemaphoreGive(s_uplink.lock);
+}
+
+void udp_uplink_deinit(void) {
+    if (!s_uplink.lock) return;
+    udp_uplink_flush();
+    esp_timer_stop(s_uplink.window_timer);
+    esp_timer_delete(s_uplink.window_timer);
+    s_uplink.window_timer = NULL;
+    vSemaphoreDelete(s_uplink.lock);
+    s_uplink.lock = NULL;
+}
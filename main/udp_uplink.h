@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "agv_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UDP_UPLINK_DEFAULT_WINDOW_US    5000
+#define UDP_UPLINK_DEFAULT_MAX_EVENTS   32
+
+typedef enum {
+    UDP_UPLINK_PRIO_NORMAL = 0,     // May wait up to the flush window for other events
+    UDP_UPLINK_PRIO_URGENT,         // Sent immediately together with anything already pending
+} udp_uplink_prio_t;
+
+/**
+ * @brief Datagram sink, same contract as udp_service_send()
+ *
+ * @return Number of bytes sent, or -1 on error
+ */
+typedef int (*udp_uplink_send_fn_t)(const char *data, size_t len);
+
+typedef struct {
+    udp_uplink_send_fn_t send;      // Usually udp_service_send
+    uint32_t flush_window_us;       // Longest time a normal event is held back, 0 = default
+    uint16_t max_events;            // Flush once this many messages are pending, 0 = default
+} udp_uplink_config_t;
+
+typedef struct {
+    uint32_t events;                // Messages accepted by udp_uplink_post()
+    uint32_t datagrams;             // Datagrams handed to the sink
+    uint32_t send_errors;           // Datagrams the sink failed to send
+    uint32_t flush_size;            // Flushes because the next message did not fit
+    uint32_t flush_count;           // Flushes because max_events was reached
+    uint32_t flush_window;          // Flushes because the window expired
+    uint32_t flush_urgent;          // Flushes caused by an urgent event or udp_uplink_flush()
+} udp_uplink_stats_t;
+
+/**
+ * @brief Start the uplink aggregator
+ *
+ * Events posted with udp_uplink_post() are packed into one agv_proto datagram,
+ * which is sent when it is full, holds max_events messages, the oldest event
+ * is flush_window_us old, or an urgent event is posted.
+ *
+ * @param config Aggregator configuration, send is required
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE if already started, or ESP_ERR_NO_MEM
+ */
+esp_err_t udp_uplink_init(const udp_uplink_config_t *config);
+
+/**
+ * @brief Queue one message for the server, timestamped now
+ *
+ * Urgent events are handed to the sink from the calling task before returning.
+ *
+ * @param type    Message type
+ * @param payload Payload of exactly the size defined for type
+ * @param len     Payload length
+ * @param prio    Event priority
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if not started, ESP_ERR_INVALID_ARG for a bad type/length,
+ *         or ESP_FAIL if an urgent flush could not be sent
+ */
+esp_err_t udp_uplink_post(agv_msg_type_t type, const void *payload, size_t len, udp_uplink_prio_t prio);
+
+/**
+ * @brief Queue one message with a caller-owned sequence number and timestamp
+ *
+ * For messages that are retransmitted until acknowledged, see udp_reliable.h.
+ *
+ * @param type         Message type
+ * @param seq          From agv_proto_next_seq(), the same on every retransmission
+ * @param timestamp_us From udp_uplink_event_us() at the event, sent as given
+ * @param payload      Payload of exactly the size defined for type
+ * @param len          Payload length
+ * @param prio         Event priority
+ * @return Same as udp_uplink_post()
+ */
+esp_err_t udp_uplink_post_seq(agv_msg_type_t type, uint32_t seq, uint64_t timestamp_us,
+                              const void *payload, size_t len, udp_uplink_prio_t prio);
+
+/**
+ * @brief udp_uplink_post() and udp_uplink_post_seq() that never wait for another producer
+ *
+ * For esp_timer callbacks, which must not block.
+ *
+ * @return Same as the blocking calls, or ESP_ERR_TIMEOUT if another task holds the
+ *         aggregator; nothing was queued then
+ */
+esp_err_t udp_uplink_try_post(agv_msg_type_t type, const void *payload, size_t len, udp_uplink_prio_t prio);
+esp_err_t udp_uplink_try_post_seq(agv_msg_type_t type, uint32_t seq, uint64_t timestamp_us,
+                                  const void *payload, size_t len, udp_uplink_prio_t prio);
+
+/**
+ * @brief Stamp for an event at local time local_us, fleet time once the clock is synced
+ *
+ * Taken once per event, so every copy of a retransmitted message carries the same stamp.
+ *
+ * @param local_us Event time from agv_proto_now_us()
+ * @return Fleet time, or local_us while clock_sync has no offset
+ */
+uint64_t udp_uplink_event_us(uint64_t local_us);
+
+/**
+ * @brief Send pending events now
+ */
+void udp_uplink_flush(void);
+
+/**
+ * @brief Read the aggregator counters
+ */
+void udp_uplink_get_stats(udp_uplink_stats_t *stats);
+
+/**
+ * @brief Flush pending events and stop the aggregator
+ */
+void udp_uplink_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
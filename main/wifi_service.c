@@ -1,29 +1,250 @@
+#include <string.h>
+#include <inttypes.h>
 #include "wifi_service.h"
 #include "esp_wifi.h"
+#include "esp_wnm.h"
+#include "esp_mac.h"
 #include "esp_event.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "esp_log.h"
 
 // ✅ Replace with your credentials
 #define WIFI_SSID "Fractavisual"
 #define WIFI_PASS "lsala123"
 
+// Last AP, so a reboot or reconnect skips the all-channel scan
+#define WIFI_NVS_NAMESPACE      "wifi_fast"
+#define WIFI_NVS_KEY_AP         "ap"
+#define WIFI_FAST_CONNECT_TRIES 2       // Cached AP attempts before scanning every channel
+
+#define WIFI_ROAM_RSSI_DBM      -70     // Look for a better AP below this
+#define WIFI_ROAM_HYSTERESIS_DB 8       // A candidate must beat the current AP by this much
+#define WIFI_ROAM_HOLDOFF_US    3000000 // Between two roam attempts
+#define WIFI_ROAM_SCAN_MAX_AP   16
+#define WIFI_ROAM_SCAN_DWELL_MS 30      // Per channel, short enough to keep the link usable
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_cached_ap_t;
+
 static const char *TAG_WIFI = "wifi";
 EventGroupHandle_t wifi_event_group;
+static wifi_service_link_cb_t link_cb;
+static void *link_cb_arg;
+
+static wifi_config_t wifi_config;
+static wifi_cached_ap_t cached_ap;
+static bool cached_ap_valid;
+static uint8_t failed_attempts;     // Since the last successful association
+static bool roaming;                // wifi_config targets a better AP, the next disconnect is ours
+static bool roam_scan_pending;
+static int64_t last_roam_us;
+static int64_t disconnected_us;     // Start of the current outage, 0 while connected
+
+static wifi_service_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void wifi_service_set_link_cb(wifi_service_link_cb_t cb, void *arg)
+{
+    link_cb = cb;
+    link_cb_arg = arg;
+}
+
+bool wifi_service_is_connected(void)
+{
+    return wifi_event_group && (xEventGroupGetBits(wifi_event_group) & WIFI_CONNECTED_BIT);
+}
+
+void wifi_service_get_stats(wifi_service_stats_t *out)
+{
+    if (!out) return;
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+static void wifi_load_cached_ap(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) return;
+    size_t len = sizeof(cached_ap);
+    cached_ap_valid = nvs_get_blob(nvs, WIFI_NVS_KEY_AP, &cached_ap, &len) == ESP_OK
+                      && len == sizeof(cached_ap) && cached_ap.channel;
+    nvs_close(nvs);
+    if (cached_ap_valid) {
+        ESP_LOGI(TAG_WIFI, "Cached AP " MACSTR " on channel %d", MAC2STR(cached_ap.bssid), cached_ap.channel);
+    }
+}
+
+// Flash is written only when the AP changes, not on every reconnect
+static void wifi_save_cached_ap(const uint8_t *bssid, uint8_t channel)
+{
+    if (cached_ap_valid && cached_ap.channel == channel && !memcmp(cached_ap.bssid, bssid, 6)) return;
+    memcpy(cached_ap.bssid, bssid, 6);
+    cached_ap.channel = channel;
+    cached_ap_valid = true;
+
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) return;
+    if (nvs_set_blob(nvs, WIFI_NVS_KEY_AP, &cached_ap, sizeof(cached_ap)) != ESP_OK
+        || nvs_commit(nvs) != ESP_OK) {
+        ESP_LOGW(TAG_WIFI, "Failed to cache the AP");
+    }
+    nvs_close(nvs);
+}
+
+// Lock the next connect to one AP and channel, or NULL to scan every channel for the strongest
+static void wifi_set_target(const uint8_t *bssid, uint8_t channel)
+{
+    wifi_config.sta.bssid_set = bssid != NULL;
+    if (bssid) memcpy(wifi_config.sta.bssid, bssid, 6);
+    wifi_config.sta.channel = bssid ? channel : 0;
+    wifi_config.sta.scan_method = bssid ? WIFI_FAST_SCAN : WIFI_ALL_CHANNEL_SCAN;
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+}
+
+static void wifi_connect(void)
+{
+    if (roaming) {
+        // Target already set by the roam scan
+        roaming = false;
+    } else if (cached_ap_valid && failed_attempts < WIFI_FAST_CONNECT_TRIES) {
+        wifi_set_target(cached_ap.bssid, cached_ap.channel);
+        taskENTER_CRITICAL(&stats_lock);
+        stats.fast_connects++;
+        taskEXIT_CRITICAL(&stats_lock);
+    } else {
+        // The cached AP is gone or out of reach
+        wifi_set_target(NULL, 0);
+        taskENTER_CRITICAL(&stats_lock);
+        stats.full_scans++;
+        taskEXIT_CRITICAL(&stats_lock);
+    }
+    esp_wifi_connect();
+}
+
+// The driver reports RSSI below the threshold once, set it again to hear about the next drop
+static void wifi_arm_roam(void)
+{
+    esp_wifi_set_rssi_threshold(WIFI_ROAM_RSSI_DBM);
+}
+
+static void wifi_start_roam(int32_t rssi)
+{
+    const int64_t now = esp_timer_get_time();
+    if (roam_scan_pending || (last_roam_us && now - last_roam_us < WIFI_ROAM_HOLDOFF_US)) {
+        wifi_arm_roam();
+        return;
+    }
+    last_roam_us = now;
+    ESP_LOGI(TAG_WIFI, "RSSI %" PRId32 " dBm, looking for a better AP", rssi);
+
+    // 802.11v: the AP knows its neighbours and steers us, with 802.11r the move skips the 4-way handshake
+    if (esp_wnm_is_btm_supported_connection()
+        && esp_wnm_send_bss_transition_mgmt_query(REASON_RSSI, NULL, 0) == 0) {
+        wifi_arm_roam();
+        return;
+    }
+
+    const wifi_scan_config_t scan = {
+        .ssid = (uint8_t *)WIFI_SSID,
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+        .scan_time.active = { .min = WIFI_ROAM_SCAN_DWELL_MS, .max = WIFI_ROAM_SCAN_DWELL_MS },
+    };
+    roam_scan_pending = esp_wifi_scan_start(&scan, false) == ESP_OK;
+    if (roam_scan_pending) {
+        taskENTER_CRITICAL(&stats_lock);
+        stats.roam_scans++;
+        taskEXIT_CRITICAL(&stats_lock);
+    } else {
+        wifi_arm_roam();
+    }
+}
+
+static void wifi_roam_scan_done(void)
+{
+    static wifi_ap_record_t records[WIFI_ROAM_SCAN_MAX_AP];
+    uint16_t num = WIFI_ROAM_SCAN_MAX_AP;
+    wifi_ap_record_t current;
+
+    roam_scan_pending = false;
+    if (esp_wifi_scan_get_ap_records(&num, records) != ESP_OK || esp_wifi_sta_get_ap_info(&current) != ESP_OK) {
+        esp_wifi_clear_ap_list();
+        wifi_arm_roam();
+        return;
+    }
+
+    const wifi_ap_record_t *best = NULL;
+    for (int i = 0; i < num; i++) {
+        if (!memcmp(records[i].bssid, current.bssid, 6)) continue;
+        if (records[i].rssi < current.rssi + WIFI_ROAM_HYSTERESIS_DB) continue;
+        if (!best || records[i].rssi > best->rssi) best = &records[i];
+    }
+    if (!best) {
+        wifi_arm_roam();
+        return;
+    }
+
+    ESP_LOGI(TAG_WIFI, "Roaming to " MACSTR " on channel %d, %d dBm (was %d dBm)",
+             MAC2STR(best->bssid), best->primary, best->rssi, current.rssi);
+    taskENTER_CRITICAL(&stats_lock);
+    stats.roams++;
+    taskEXIT_CRITICAL(&stats_lock);
+    roaming = true;
+    wifi_set_target(best->bssid, best->primary);
+    esp_wifi_disconnect();
+}
 
 static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                                int32_t event_id, void *event_data)
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
+        wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        wifi_event_sta_connected_t *event = (wifi_event_sta_connected_t *) event_data;
+        failed_attempts = 0;
+        wifi_save_cached_ap(event->bssid, event->channel);
+        wifi_arm_roam();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        esp_wifi_connect();
+        // Only the first disconnect of an outage is reported, retries fail the same way
+        EventBits_t bits = xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT);
+        if (bits & WIFI_CONNECTED_BIT) {
+            disconnected_us = esp_timer_get_time();
+            taskENTER_CRITICAL(&stats_lock);
+            stats.disconnects++;
+            taskEXIT_CRITICAL(&stats_lock);
+            if (link_cb) link_cb(false, link_cb_arg);
+        } else if (!roaming && failed_attempts < UINT8_MAX) {
+            failed_attempts++;
+        }
+        wifi_connect();
         ESP_LOGI(TAG_WIFI, "Retrying connection to the AP");
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_BSS_RSSI_LOW) {
+        wifi_event_bss_rssi_low_t *event = (wifi_event_bss_rssi_low_t *) event_data;
+        wifi_start_roam(event->rssi);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_SCAN_DONE) {
+        if (roam_scan_pending) wifi_roam_scan_done();
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
-        ESP_LOGI(TAG_WIFI, "Got IP Address: " IPSTR, IP2STR(&event->ip_info.ip));
+        if (disconnected_us) {
+            const uint32_t outage_us = (uint32_t)(esp_timer_get_time() - disconnected_us);
+            disconnected_us = 0;
+            taskENTER_CRITICAL(&stats_lock);
+            stats.last_outage_us = outage_us;
+            if (outage_us > stats.max_outage_us) stats.max_outage_us = outage_us;
+            stats.total_outage_us += outage_us;
+            taskEXIT_CRITICAL(&stats_lock);
+            ESP_LOGI(TAG_WIFI, "Got IP Address: " IPSTR " after %" PRIu32 " ms offline",
+                     IP2STR(&event->ip_info.ip), outage_us / 1000);
+        } else {
+            ESP_LOGI(TAG_WIFI, "Got IP Address: " IPSTR, IP2STR(&event->ip_info.ip));
+        }
         xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
+        if (link_cb) link_cb(true, link_cb_arg);
     }
 }
 
@@ -52,13 +273,19 @@ void wifi_service_init(void)
                                                         NULL,
                                                         &instance_got_ip));
 
-    wifi_config_t wifi_config = {
+    wifi_config = (wifi_config_t) {
         .sta = {
             .ssid = WIFI_SSID,
             .password = WIFI_PASS,
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK
+            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
+            .sort_method = WIFI_CONNECT_AP_BY_SIGNAL,
+            // 802.11k neighbour reports, 802.11v BSS transition and 802.11r fast transition
+            .rm_enabled = 1,
+            .btm_enabled = 1,
+            .ft_enabled = 1,
         },
     };
+    wifi_load_cached_ap();
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
@@ -69,15 +296,6 @@ void wifi_service_init(void)
 
     ESP_ERROR_CHECK(esp_wifi_start());
 
-    ESP_LOGI(TAG_WIFI, "Wi-Fi init finished.");
-
-    // Wait until connected
-    EventBits_t bits = xEventGroupWaitBits(wifi_event_group,
-                                           WIFI_CONNECTED_BIT,
-                                           pdFALSE,
-                                           pdTRUE,
-                                           portMAX_DELAY);
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG_WIFI, "Connected to AP");
-    }
+    // Association, DHCP and reconnects run in the event handler
+    ESP_LOGI(TAG_WIFI, "Wi-Fi init finished, connecting in the background");
 }
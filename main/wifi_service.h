@@ -4,14 +4,41 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
 
-// Event bit for successful Wi-Fi connection
+// Event bit for successful Wi-Fi connection, cleared again on disconnect
 #define WIFI_CONNECTED_BIT BIT0
 
+// Called from the default event loop task when the station gets an IP or loses the AP
+typedef void (*wifi_service_link_cb_t)(bool connected, void *arg);
+
+// Link counters; an outage runs from losing the AP to the next IP address
+typedef struct {
+    uint32_t disconnects;
+    uint32_t fast_connects;     // Attempts on the cached BSSID and channel
+    uint32_t full_scans;        // Attempts that scanned every channel
+    uint32_t roam_scans;        // Background scans after the RSSI dropped
+    uint32_t roams;             // Moves to a stronger AP found by a roam scan
+    uint32_t last_outage_us;
+    uint32_t max_outage_us;
+    uint64_t total_outage_us;
+} wifi_service_stats_t;
+
 // Expose event group so other tasks can wait on it
 extern EventGroupHandle_t wifi_event_group;
 
-// Initialize Wi-Fi (STA mode)
+// Register the link state callback, call before wifi_service_init()
+void wifi_service_set_link_cb(wifi_service_link_cb_t cb, void *arg);
+
+// Whether the station has an IP address now, WIFI_CONNECTED_BIT; false before wifi_service_init()
+bool wifi_service_is_connected(void);
+
+// Read the link counters
+void wifi_service_get_stats(wifi_service_stats_t *stats);
+
+// Initialize Wi-Fi (STA mode) and return without waiting for the AP;
+// wait on WIFI_CONNECTED_BIT or use the link callback to know when it is up
 void wifi_service_init(void);
 
 #endif // WIFI_SERVICE_H
@@ -1,19 +1,362 @@
+import json
+import os
+import random
+import re
 import socket
+import struct
 import time
+from collections import deque
+
+import dlog_decode
 
 UDP_PORT = 8888  # ESP32 is sending here
-sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-sock.bind(("0.0.0.0", UDP_PORT))
 
-print(f"Listening for RFID tags on UDP port {UDP_PORT}...")
+# Binary protocol, keep in sync with main/agv_proto.h (all fields little-endian)
+PROTO_MAGIC = 0xA6
+PROTO_VERSION = 3
+DGRAM_HDR = struct.Struct("<BBHIQ")    # magic, version, agv_id, boot_id, tx_us (sender clock at sendto)
+MSG_HDR = struct.Struct("<BBIQ")       # type, len, seq, timestamp_us
+
+MSG_HELLO = 0x01
+MSG_TAG = 0x02
+MSG_SENSOR = 0x03
+MSG_COMMAND = 0x04
+MSG_ZONE = 0x05
+MSG_ACK = 0x06
+MSG_BOOT = 0x07
+MSG_LOG = 0x08
+MSG_METRICS = 0x09
+MSG_HISTOGRAM = 0x0A
+MSG_TIME_REQ = 0x0B
+MSG_TIME_RESP = 0x0C
+MSG_PROFILE = 0x0D
+MSG_TASK = 0x0E
+
+# AGV timestamps at or above this are fleet time (ours, Unix epoch), below it uptime before sync
+FLEET_TIME_MIN_US = 1_000_000_000_000_000
+
+ZONE_NAMES = ("front", "rear", "left", "right")
+ZONE_STATES = ("clear", "slow", "stop")
+
+CMD_LED_GREEN_ON = 0x01
+CMD_LED_GREEN_OFF = 0x02
+CMD_LED_GREEN_BLINK = 0x03
+
+# boot_stage_t order in main/boot_trace.h
+BOOT_STAGES = ("nvs", "wifi_init", "wifi_connect", "uplink", "usb_host", "hid", "sensors",
+               "hid_enum", "hid_report_desc")
+BOOT_MAX_STAGES = 12
+BOOT_LOG = "boot_traces.jsonl"     # One line per boot, read by boot_report.py
+
+METRICS_DEFS_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), "main", "metrics_defs.h")
+METRICS_MAX_COUNTERS = 32
+HIST_BUCKETS = 20      # Bucket b holds durations below 2**b us, the last one everything longer
+HIST_PERCENTILES = (50, 90, 99)
+TAG_SAMPLES = 1000     # Recent tags per AGV whose stage times are summarized with each metrics report
+
+TASK_NAME_MAX = 16
+TASK_STATES = ("running", "ready", "blocked", "suspended", "deleted", "invalid")     # eTaskState
+TASK_CORE_ANY = 0xFF
+TASK_CPU_UNKNOWN = 0xFFFF
+STACK_LOW_BYTES = 512   # Less stack than this never touched is worth a look
+
+TAG_MAX = 24
+PAYLOADS = {
+    MSG_HELLO: None,
+    MSG_TAG: struct.Struct(f"<B{TAG_MAX}sII"),  # len, tag, usb_us, decode_us
+    MSG_SENSOR: struct.Struct("<BBH"),         # sensor_id, triggered, distance
+    MSG_COMMAND: struct.Struct("<BBH"),        # command, arg, duration_ms
+    MSG_ZONE: struct.Struct("<BBBBH"),         # zone, state, prev_state, sensor_id, distance
+    MSG_ACK: struct.Struct("<IIQQ"),           # base_seq, mask (bit i acknowledges base_seq + i), echo_tx_us, rx_us
+    MSG_BOOT: struct.Struct(f"<BBH{2 * BOOT_MAX_STAGES}I"),    # count, reset_reason, reserved, (begin_us, end_us)*
+    MSG_LOG: dlog_decode.LOG_PAYLOAD,          # fmt_id, nargs, str_len, args, str; see dlog_decode.py
+    MSG_METRICS: struct.Struct(f"<IB3x{METRICS_MAX_COUNTERS}I"),  # uptime_ms, count, counters
+    MSG_HISTOGRAM: struct.Struct(f"<B3xI{HIST_BUCKETS}I"),       # id, max_us, buckets
+    MSG_TIME_REQ: struct.Struct("<I"),         # id
+    MSG_TIME_RESP: struct.Struct("<I4xQQ"),    # id, echo_tx_us, rx_us
+    MSG_PROFILE: struct.Struct("<IIIIBBBB"),   # period_us, heap_free, heap_min_free, heap_largest,
+                                               # task_count, queue_len, queue_waiting, queue_max
+    MSG_TASK: struct.Struct(f"<{TASK_NAME_MAX}sBBBxHH"),  # name, core, priority, state, cpu_permille, stack_free_min
+}
+
+# Message types the AGV retransmits until they are acknowledged
+RELIABLE = (MSG_TAG,)
+SEEN_SEQS = 1024    # Per AGV, well above its retransmit window
+
+
+def payload_size(msg_type):
+    payload = PAYLOADS[msg_type]
+    return payload.size if payload else 0
+
+
+def now_us():
+    """Fleet clock for tx_us and rx_us, the AGVs sync to it with MSG_TIME_REQ."""
+    return time.time_ns() // 1000
+
+
+def decode_datagram(data):
+    """Return (agv_id, boot_id, tx_us, [(type, seq, timestamp_us, fields), ...]) or None if invalid."""
+    if len(data) < DGRAM_HDR.size:
+        return None
+    magic, version, agv_id, boot_id, tx_us = DGRAM_HDR.unpack_from(data, 0)
+    if magic != PROTO_MAGIC or version != PROTO_VERSION:
+        return None
+
+    messages = []
+    offset = DGRAM_HDR.size
+    while offset + MSG_HDR.size <= len(data):
+        msg_type, length, seq, timestamp_us = MSG_HDR.unpack_from(data, offset)
+        offset += MSG_HDR.size
+        if msg_type not in PAYLOADS or length != payload_size(msg_type) or offset + length > len(data):
+            break
+        payload = PAYLOADS[msg_type]
+        fields = payload.unpack_from(data, offset) if payload else ()
+        offset += length
+        messages.append((msg_type, seq, timestamp_us, fields))
+    return agv_id, boot_id, tx_us, messages
+
+
+class Encoder:
+    """Builds datagrams to send to an AGV, with our own sequence numbers."""
+
+    def __init__(self, agv_id=0):
+        self.agv_id = agv_id
+        self.boot_id = random.getrandbits(32)
+        self.seq = 0
+        self.start = time.monotonic()
+
+    def datagram(self, *messages):
+        """Build a datagram stamped with the current time, send it right away."""
+        out = bytearray(DGRAM_HDR.pack(PROTO_MAGIC, PROTO_VERSION, self.agv_id, self.boot_id, now_us()))
+        for msg_type, fields in messages:
+            payload = PAYLOADS[msg_type].pack(*fields) if PAYLOADS[msg_type] else b""
+            timestamp_us = int((time.monotonic() - self.start) * 1e6)
+            out += MSG_HDR.pack(msg_type, len(payload), self.seq & 0xFFFFFFFF, timestamp_us)
+            out += payload
+            self.seq += 1
+        return bytes(out)
+
+
+def ack_messages(seqs, echo_tx_us, rx_us):
+    """Cover the given seqs with as few MSG_ACK messages as possible.
+
+    Every ACK echoes the tx_us of the datagram it answers and when we received it,
+    so the AGV can tell its round trip from our hold time.
+    """
+    acks = []
+    for seq in sorted(set(seqs)):
+        if acks and seq - acks[-1][1][0] < 32:
+            base, mask = acks[-1][1][:2]
+            acks[-1] = (MSG_ACK, (base, mask | (1 << (seq - base)), echo_tx_us, rx_us))
+        else:
+            acks.append((MSG_ACK, (seq, 1, echo_tx_us, rx_us)))
+    return acks
+
+
+def boot_trace(agv_id, fields):
+    """Turn MSG_BOOT fields into a dict of stage -> [begin_ms, duration_ms or None]."""
+    count, reset_reason = fields[0], fields[1]
+    spans = fields[3:]
+    stages = {}
+    for i in range(min(count, BOOT_MAX_STAGES)):
+        begin_us, end_us = spans[2 * i], spans[2 * i + 1]
+        if not begin_us:
+            continue
+        name = BOOT_STAGES[i] if i < len(BOOT_STAGES) else f"stage{i}"
+        stages[name] = [begin_us / 1000, (end_us - begin_us) / 1000 if end_us else None]
+    return {"agv_id": agv_id, "time": time.time(), "reset_reason": reset_reason, "stages": stages}
+
+
+def load_metric_names(path=METRICS_DEFS_H):
+    """Return ([counter names], [histogram names]) in wire order."""
+    names = {"METRIC_COUNTER": [], "METRIC_HISTOGRAM": []}
+    pattern = re.compile(r'^\s*(METRIC_COUNTER|METRIC_HISTOGRAM)\(\s*\w+\s*,\s*"([^"]*)"\s*\)')
+    with open(path) as header:
+        for line in header:
+            match = pattern.match(line)
+            if match:
+                names[match.group(1)].append(match.group(2))
+    return names["METRIC_COUNTER"], names["METRIC_HISTOGRAM"]
+
+
+def histogram_percentile(buckets, max_us, pct):
+    """Upper bound in us of the bucket holding the pct-th percentile, None if empty."""
+    total = sum(buckets)
+    if not total:
+        return None
+    rank = pct / 100 * total
+    seen = 0
+    for bucket, n in enumerate(buckets):
+        seen += n
+        if n and seen >= rank:
+            return min((1 << bucket) - 1, max_us) if bucket < HIST_BUCKETS - 1 else max_us
+    return max_us
+
+
+class TagStages:
+    """Exact stage times of one AGV's recent tags, next to its log2 METRIC_TAG_* histograms."""
+
+    def __init__(self):
+        self.samples = {}   # stage -> deque of us
+
+    def add(self, stage, value_us):
+        if value_us is not None:
+            self.samples.setdefault(stage, deque(maxlen=TAG_SAMPLES)).append(value_us)
+
+    def summary(self):
+        """Yield (stage, count, {pct: us}, max_us) per stage, nearest-rank percentiles."""
+        for stage, values in self.samples.items():
+            ordered = sorted(values)
+            pcts = {pct: ordered[max(0, -(-pct * len(ordered) // 100) - 1)] for pct in HIST_PERCENTILES}
+            yield stage, len(ordered), pcts, ordered[-1]
+
+
+class SeenSeqs:
+    """Recently delivered seqs of one AGV, so retransmitted copies are acknowledged but not handled twice."""
+
+    def __init__(self):
+        self.order = deque()
+        self.seen = set()
+
+    def add(self, seq):
+        """Return True the first time seq is seen."""
+        if seq in self.seen:
+            return False
+        self.seen.add(seq)
+        self.order.append(seq)
+        if len(self.order) > SEEN_SEQS:
+            self.seen.discard(self.order.popleft())
+        return True
+
+
+def main():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("0.0.0.0", UDP_PORT))
+    encoder = Encoder()
+    agvs = {}   # agv_id -> (boot_id, SeenSeqs)
+    log_formats = dlog_decode.load_formats()
+    counter_names, histogram_names = load_metric_names()
+    last_counters = {}  # agv_id -> counters of the previous report, the AGV sends totals
+    tag_stages = {}     # agv_id -> TagStages
+
+    print(f"Listening for RFID tags on UDP port {UDP_PORT}...")
+
+    while True:
+        data, addr = sock.recvfrom(2048)
+        rx_us = now_us()
+        decoded = decode_datagram(data)
+        if decoded is None:
+            print(f"Invalid datagram from {addr}: {data!r}")
+            continue
+
+        agv_id, boot_id, tx_us, messages = decoded
+        if agv_id not in agvs or agvs[agv_id][0] != boot_id:
+            # Rebooted: its sequence numbers start over, and so do its counters.
+            # Told by the header of any datagram, a lost HELLO does not matter.
+            agvs[agv_id] = (boot_id, SeenSeqs())
+            last_counters.pop(agv_id, None)
+            tag_stages[agv_id] = TagStages()
+        seen = agvs[agv_id][1]
+        to_ack = []
+        for msg_type, seq, timestamp_us, fields in messages:
+            if msg_type in RELIABLE:
+                to_ack.append(seq)
+                if not seen.add(seq):
+                    print(f"AGV {agv_id} #{seq} retransmitted, already handled")
+                    continue
+
+            if msg_type == MSG_TAG:
+                tag = fields[1][:fields[0]].decode(errors="replace")
+                usb_us, decode_us = fields[2], fields[3]
+                stages = tag_stages[agv_id]
+                stages.add("usb", usb_us)
+                stages.add("decode", decode_us)
+                if timestamp_us >= FLEET_TIME_MIN_US:
+                    # Synced: read to us, Wi-Fi included, on one clock
+                    when = time.strftime("%H:%M:%S", time.localtime(timestamp_us / 1e6))
+                    stages.add("post_to_server", rx_us - timestamp_us if rx_us >= timestamp_us else None)
+                    print(f"AGV {agv_id} #{seq} at {when}.{timestamp_us % 1000000:06d} tag: {tag} "
+                          f"(usb {usb_us} us, decode {decode_us} us, age {rx_us - timestamp_us} us)")
+                else:
+                    # Both AGV clock; Wi-Fi and our own time are timed by the AGV from the ACK
+                    queue_us = tx_us - timestamp_us if tx_us >= timestamp_us else None
+                    stages.add("queue", queue_us)
+                    print(f"AGV {agv_id} #{seq} t={timestamp_us}us tag: {tag} "
+                          f"(usb {usb_us} us, decode {decode_us} us, queue {queue_us} us)")
+
+                # Send back a message to ESP32
+                reply = encoder.datagram((MSG_COMMAND, (CMD_LED_GREEN_ON, 0, 2000)))
+                sock.sendto(reply, addr)
+                print(f"Sent LED_GREEN_ON to {addr}")
+            elif msg_type == MSG_SENSOR:
+                sensor_id, triggered, distance = fields
+                print(f"AGV {agv_id} #{seq} t={timestamp_us}us sensor {sensor_id}: "
+                      f"distance {distance} mm{' TRIGGERED' if triggered else ''}")
+            elif msg_type == MSG_ZONE:
+                zone, state, prev_state, sensor_id, distance = fields
+                # A newer firmware may know zones or states this table does not
+                zone = ZONE_NAMES[zone] if zone < len(ZONE_NAMES) else str(zone)
+                state = ZONE_STATES[state] if state < len(ZONE_STATES) else str(state)
+                prev_state = ZONE_STATES[prev_state] if prev_state < len(ZONE_STATES) else str(prev_state)
+                print(f"AGV {agv_id} #{seq} t={timestamp_us}us {zone} zone "
+                      f"{prev_state} -> {state} (sensor {sensor_id}, {distance} mm)")
+            elif msg_type == MSG_BOOT:
+                trace = boot_trace(agv_id, fields)
+                print(f"AGV {agv_id} #{seq} boot trace, reset reason {trace['reset_reason']}:")
+                for name, (begin_ms, took_ms) in trace["stages"].items():
+                    took = f"{took_ms:9.1f} ms" if took_ms is not None else "  running"
+                    print(f"    {name:<16} at {begin_ms:9.1f} ms took {took}")
+                with open(BOOT_LOG, "a") as log:
+                    log.write(json.dumps(trace) + "\n")
+            elif msg_type == MSG_LOG:
+                print(f"AGV {agv_id} #{seq} {dlog_decode.format_line(log_formats, timestamp_us, fields)}")
+            elif msg_type == MSG_METRICS:
+                uptime_ms, count = fields[0], min(fields[1], METRICS_MAX_COUNTERS)
+                counters = fields[2:2 + count]
+                previous = last_counters.get(agv_id, (0,) * count)
+                last_counters[agv_id] = counters
+                print(f"AGV {agv_id} #{seq} metrics at {uptime_ms / 1000:.1f} s (total, +since last):")
+                for i, value in enumerate(counters):
+                    name = counter_names[i] if i < len(counter_names) else f"counter{i}"
+                    delta = value - previous[i] if i < len(previous) and value >= previous[i] else value
+                    print(f"    {name:<20} {value:10d} {'+' + str(delta):>8}")
+                # Exact, over the last TAG_SAMPLES tags; the histograms that follow cover every tag since boot
+                for stage, count, pcts, max_us in tag_stages[agv_id].summary():
+                    print(f"    tag {stage:<16} n={count} " + " ".join(f"p{pct}={us}" for pct, us in pcts.items())
+                          + f" max={max_us} us")
+            elif msg_type == MSG_HISTOGRAM:
+                hist_id, max_us, buckets = fields[0], fields[1], fields[2:]
+                name = histogram_names[hist_id] if hist_id < len(histogram_names) else f"histogram{hist_id}"
+                if sum(buckets):
+                    pcts = " ".join(f"p{pct}<={histogram_percentile(buckets, max_us, pct)}"
+                                    for pct in HIST_PERCENTILES)
+                    print(f"    {name:<20} n={sum(buckets)} {pcts} max={max_us} us")
+                else:
+                    print(f"    {name:<20} n=0")
+            elif msg_type == MSG_PROFILE:
+                period_us, heap_free, heap_min_free, heap_largest, task_count, queue_len, waiting, queue_max = fields
+                queue = f", event queue {waiting}/{queue_len} (max {queue_max})" if queue_len else ""
+                print(f"AGV {agv_id} #{seq} profile over {period_us / 1e6:.1f} s, {task_count} tasks, heap free "
+                      f"{heap_free} (min {heap_min_free}, largest block {heap_largest}) bytes{queue}:")
+                print(f"    {'task':<16} core prio {'state':<9}   cpu  stack free")
+            elif msg_type == MSG_TASK:
+                name, core, priority, state, cpu_permille, stack_free = fields
+                name = name.split(b"\0", 1)[0].decode(errors="replace")
+                core = "any" if core == TASK_CORE_ANY else str(core)
+                state = TASK_STATES[state] if state < len(TASK_STATES) else str(state)
+                cpu = "     -" if cpu_permille == TASK_CPU_UNKNOWN else f"{cpu_permille / 10:5.1f}%"
+                low = " LOW" if stack_free < STACK_LOW_BYTES else ""
+                print(f"    {name:<16} {core:>4} {priority:4d} {state:<9} {cpu} {stack_free:7d} B{low}")
+            elif msg_type == MSG_TIME_REQ:
+                # Answer at once: the time spent here is taken out, but a queue behind it is not
+                sock.sendto(encoder.datagram((MSG_TIME_RESP, (fields[0], tx_us, rx_us))), addr)
+            elif msg_type == MSG_HELLO:
+                print(f"AGV {agv_id} online from {addr}, boot {boot_id:08x}")
 
-while True:
-    data, addr = sock.recvfrom(1024)
-    tag = data.decode()
-    print(f"Tag received from {addr}: {tag}")
+        # One ACK datagram per received datagram, copies included: the first ACK may have been lost
+        if to_ack:
+            sock.sendto(encoder.datagram(*ack_messages(to_ack, tx_us, rx_us)), addr)
 
-    # Send back a message to ESP32
-    reply_msg = "LED_GREEN_ON"
-    sock.sendto(reply_msg.encode(), addr)
-    print(f"Sent reply to {addr}: {reply_msg}")
 
+if __name__ == "__main__":
+    main()